@@ -11,10 +11,34 @@ out Data
 
 uniform mat4 u_mvp;
 
+// Compact vertex streams: 16 bit unorm positions within the given bounds and
+// octahedral encoded normals in the first two components.
+uniform bool u_packed;
+uniform vec3 u_position_min;
+uniform vec3 u_position_extent;
+
+vec3 octahedral_decode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return n;
+}
+
 void main()
 {
-	data.Normal = normalize(VertexNormal);
-	data.Position = VertexPosition;
+	vec3 position = VertexPosition;
+	vec3 normal = VertexNormal;
+	if (u_packed)
+	{
+		position = u_position_min + VertexPosition * u_position_extent;
+		normal = octahedral_decode(VertexNormal.xy);
+	}
+
+	data.Normal = normalize(normal);
+	data.Position = position;
  
-	gl_Position = vec4(VertexPosition, 1.0) * u_mvp;
+	gl_Position = vec4(position, 1.0) * u_mvp;
 }
\ No newline at end of file
@@ -14,6 +14,13 @@
 #define GA_MSVC
 #elif defined(__MINGW32__)
 #define GA_MINGW
+#elif defined(__GNUC__)
+#define GA_GCC
+#endif
+
+// Platforms.
+#if defined(__linux__)
+#define GA_LINUX
 #endif
 
 // Architecture.
@@ -28,3 +35,25 @@
 #if defined(__MINGW32__)
 #define GA_32_BIT
 #endif
+
+#if defined(GA_GCC)
+#if defined(__x86_64__)
+#define GA_64_BIT
+#define GA_X64
+#elif defined(__aarch64__)
+#define GA_64_BIT
+#define GA_ARM64
+#endif
+#endif
+
+// Instruction sets.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define GA_SSE2
+#endif
+
+// Function attributes.
+#if defined(GA_MSVC)
+#define GA_NOINLINE __declspec(noinline)
+#else
+#define GA_NOINLINE __attribute__((noinline))
+#endif
@@ -9,6 +9,8 @@
 ** This file is distributed under the MIT License. See LICENSE.txt.
 */
 
+#include "ga_frame_allocator.h"
+
 #include "math/ga_mat4f.h"
 #include "math/ga_vec2f.h"
 #include "math/ga_vec3f.h"
@@ -44,13 +46,33 @@ struct ga_static_drawcall : ga_drawcall
 
 /*
 ** Draw call with dynamic geometry.
-** Geometry referenced by this draw call should only a single frame.
+** Geometry referenced by this draw call should only a single frame. Its
+** arrays come from the frame allocator it's given, or the heap without one.
 */
 struct ga_dynamic_drawcall : ga_drawcall
 {
-	std::vector<ga_vec3f> _normals;
-	std::vector<ga_vec3f> _positions;
-	std::vector<ga_vec2f> _texcoords;
-	std::vector<uint16_t> _indices;
+	explicit ga_dynamic_drawcall(ga_frame_allocator* allocator = nullptr) :
+		_normals(allocator),
+		_positions(allocator),
+		_texcoords(allocator),
+		_indices(allocator),
+		_packed_positions(allocator),
+		_packed_normals(allocator)
+	{
+	}
+
+	ga_frame_vector<ga_vec3f> _normals;
+	ga_frame_vector<ga_vec3f> _positions;
+	ga_frame_vector<ga_vec2f> _texcoords;
+	ga_frame_vector<uint16_t> _indices;
 	ga_vec3f _color;
+
+	// Optional compact vertex streams, used in place of _positions and _normals
+	// when not empty. Positions are three 16 bit unorm values relative to
+	// _position_min and _position_extent, normals are octahedral encoded in two
+	// 16 bit snorm values.
+	ga_frame_vector<uint16_t> _packed_positions;
+	ga_frame_vector<int16_t> _packed_normals;
+	ga_vec3f _position_min;
+	ga_vec3f _position_extent;
 };
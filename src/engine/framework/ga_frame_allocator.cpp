@@ -0,0 +1,87 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_frame_allocator.h"
+
+#include "ga_linear_allocator.h"
+
+#include "jobs/ga_job.h"
+
+#include <mutex>
+
+struct ga_frame_allocator_impl_t
+{
+	// One arena per worker, indexed by ga_job::get_worker_index.
+	std::vector<ga_linear_allocator*> _worker_arenas;
+
+	// For threads that aren't workers.
+	ga_linear_allocator* _shared_arena;
+	std::mutex _shared_mutex;
+};
+
+ga_frame_allocator::ga_frame_allocator(size_t block_size)
+{
+	ga_frame_allocator_impl_t* impl = new ga_frame_allocator_impl_t;
+
+	int worker_count = ga_job::get_worker_count();
+	for (int i = 0; i < worker_count; ++i)
+	{
+		impl->_worker_arenas.push_back(new ga_linear_allocator(block_size));
+	}
+	impl->_shared_arena = new ga_linear_allocator(block_size);
+
+	_impl = impl;
+}
+
+ga_frame_allocator::~ga_frame_allocator()
+{
+	ga_frame_allocator_impl_t* impl = static_cast<ga_frame_allocator_impl_t*>(_impl);
+	for (auto& arena : impl->_worker_arenas)
+	{
+		delete arena;
+	}
+	delete impl->_shared_arena;
+	delete impl;
+}
+
+void* ga_frame_allocator::allocate(size_t size, size_t align)
+{
+	ga_frame_allocator_impl_t* impl = static_cast<ga_frame_allocator_impl_t*>(_impl);
+
+	// Only the worker's current job can be using its arena, so no locking is needed.
+	int worker = ga_job::get_worker_index();
+	if (worker >= 0 && worker < (int)impl->_worker_arenas.size())
+	{
+		return impl->_worker_arenas[worker]->allocate(size, align);
+	}
+
+	std::lock_guard<std::mutex> lock(impl->_shared_mutex);
+	return impl->_shared_arena->allocate(size, align);
+}
+
+void ga_frame_allocator::reset()
+{
+	ga_frame_allocator_impl_t* impl = static_cast<ga_frame_allocator_impl_t*>(_impl);
+	for (auto& arena : impl->_worker_arenas)
+	{
+		arena->reset();
+	}
+	impl->_shared_arena->reset();
+}
+
+size_t ga_frame_allocator::get_used() const
+{
+	ga_frame_allocator_impl_t* impl = static_cast<ga_frame_allocator_impl_t*>(_impl);
+	size_t used = impl->_shared_arena->get_used();
+	for (auto& arena : impl->_worker_arenas)
+	{
+		used += arena->get_used();
+	}
+	return used;
+}
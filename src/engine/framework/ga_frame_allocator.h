@@ -0,0 +1,101 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/*
+** Memory that lives for one frame.
+** Every job system worker has its own scratch arena, and allocations come
+** from the arena of whichever worker makes them, so they're a pointer bump
+** with no locks and no heap traffic. Threads outside the job system share
+** one more arena behind a lock. The whole frame's memory is released at
+** once by reset, at the frame boundary.
+**
+** Create it after the job system has started, so it knows the worker count.
+*/
+class ga_frame_allocator
+{
+public:
+	explicit ga_frame_allocator(size_t block_size = 256 * 1024);
+	~ga_frame_allocator();
+
+	void* allocate(size_t size, size_t align);
+
+	template<typename T>
+	T* allocate_array(size_t count)
+	{
+		return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+	}
+
+	/* Releases everything. Nothing may still be using the frame's memory, or allocating. */
+	void reset();
+
+	/* Bytes handed out since the last reset. */
+	size_t get_used() const;
+
+private:
+	ga_frame_allocator(const ga_frame_allocator&) = delete;
+	ga_frame_allocator& operator=(const ga_frame_allocator&) = delete;
+
+	void* _impl;
+};
+
+/*
+** Standard library allocator over a frame allocator, for containers that
+** only live for the frame. Without a frame allocator it uses the heap.
+*/
+template<typename T>
+struct ga_frame_stl_allocator
+{
+	typedef T value_type;
+
+	ga_frame_stl_allocator(ga_frame_allocator* allocator = nullptr) : _allocator(allocator) {}
+
+	template<typename U>
+	ga_frame_stl_allocator(const ga_frame_stl_allocator<U>& other) : _allocator(other._allocator) {}
+
+	T* allocate(size_t count)
+	{
+		if (_allocator)
+		{
+			return _allocator->allocate_array<T>(count);
+		}
+		return static_cast<T*>(::operator new(count * sizeof(T)));
+	}
+
+	void deallocate(T* data, size_t)
+	{
+		// Frame memory goes all at once, on reset.
+		if (!_allocator)
+		{
+			::operator delete(data);
+		}
+	}
+
+	ga_frame_allocator* _allocator;
+};
+
+template<typename T, typename U>
+bool operator==(const ga_frame_stl_allocator<T>& a, const ga_frame_stl_allocator<U>& b)
+{
+	return a._allocator == b._allocator;
+}
+
+template<typename T, typename U>
+bool operator!=(const ga_frame_stl_allocator<T>& a, const ga_frame_stl_allocator<U>& b)
+{
+	return a._allocator != b._allocator;
+}
+
+template<typename T>
+using ga_frame_vector = std::vector<T, ga_frame_stl_allocator<T>>;
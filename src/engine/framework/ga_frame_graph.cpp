@@ -0,0 +1,156 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_frame_graph.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+struct ga_frame_stage_t
+{
+	const char* _name;
+	ga_frame_stage_function_t _entry;
+	void* _data;
+	ga_job_priority_t _priority;
+
+	struct ga_frame_graph_impl_t* _graph;
+};
+
+struct ga_frame_graph_impl_t
+{
+	std::vector<ga_frame_stage_t> _stages;
+	std::vector<std::pair<int, int>> _edges;
+
+	// Per resource, the last stage to write it and the stages that read it since.
+	int _last_writer[32];
+	std::vector<int> _readers[32];
+
+	// Jobs are rebuilt from the stages after any are added, since adding may move them.
+	ga_job_graph _jobs;
+	bool _jobs_dirty;
+
+	// The frame being run.
+	struct ga_frame_params* _params;
+};
+
+static void _ga_frame_graph_stage(void* data);
+static void _ga_frame_graph_add_edge(ga_frame_graph_impl_t* impl, int before, int after);
+
+ga_frame_graph::ga_frame_graph()
+{
+	ga_frame_graph_impl_t* impl = new ga_frame_graph_impl_t;
+	std::fill(impl->_last_writer, impl->_last_writer + 32, -1);
+	impl->_jobs_dirty = false;
+	impl->_params = nullptr;
+	_impl = impl;
+}
+
+ga_frame_graph::~ga_frame_graph()
+{
+	delete static_cast<ga_frame_graph_impl_t*>(_impl);
+}
+
+int ga_frame_graph::add_stage(
+	const char* name,
+	ga_frame_stage_function_t entry,
+	void* data,
+	uint32_t reads,
+	uint32_t writes,
+	ga_job_priority_t priority)
+{
+	ga_frame_graph_impl_t* impl = static_cast<ga_frame_graph_impl_t*>(_impl);
+
+	int index = (int)impl->_stages.size();
+
+	ga_frame_stage_t stage;
+	stage._name = name;
+	stage._entry = entry;
+	stage._data = data;
+	stage._priority = priority;
+	stage._graph = impl;
+	impl->_stages.push_back(stage);
+
+	for (int resource = 0; resource < 32; ++resource)
+	{
+		uint32_t bit = uint32_t(1) << resource;
+		if (!((reads | writes) & bit))
+		{
+			continue;
+		}
+
+		// Read after write, and write after write.
+		if (impl->_last_writer[resource] >= 0)
+		{
+			_ga_frame_graph_add_edge(impl, impl->_last_writer[resource], index);
+		}
+
+		if (writes & bit)
+		{
+			// Write after read. The readers already follow the last writer.
+			for (int reader : impl->_readers[resource])
+			{
+				_ga_frame_graph_add_edge(impl, reader, index);
+			}
+			impl->_readers[resource].clear();
+			impl->_last_writer[resource] = index;
+		}
+		else
+		{
+			impl->_readers[resource].push_back(index);
+		}
+	}
+
+	impl->_jobs_dirty = true;
+	return index;
+}
+
+void ga_frame_graph::run(ga_frame_params* params, ga_job_counter_t* counter)
+{
+	ga_frame_graph_impl_t* impl = static_cast<ga_frame_graph_impl_t*>(_impl);
+
+	if (impl->_jobs_dirty)
+	{
+		impl->_jobs.clear();
+		for (auto& stage : impl->_stages)
+		{
+			impl->_jobs.add(_ga_frame_graph_stage, &stage, stage._priority, stage._name);
+		}
+		for (auto& edge : impl->_edges)
+		{
+			impl->_jobs.add_dependency(edge.first, edge.second);
+		}
+		impl->_jobs_dirty = false;
+	}
+
+	impl->_params = params;
+	impl->_jobs.run(counter);
+}
+
+int ga_frame_graph::get_stage_count() const
+{
+	ga_frame_graph_impl_t* impl = static_cast<ga_frame_graph_impl_t*>(_impl);
+	return (int)impl->_stages.size();
+}
+
+static void _ga_frame_graph_stage(void* data)
+{
+	ga_frame_stage_t* stage = static_cast<ga_frame_stage_t*>(data);
+	stage->_entry(stage->_data, stage->_graph->_params);
+}
+
+static void _ga_frame_graph_add_edge(ga_frame_graph_impl_t* impl, int before, int after)
+{
+	// Stages touching several of the same resources would otherwise add the same edge for each.
+	std::pair<int, int> edge(before, after);
+	if (std::find(impl->_edges.begin(), impl->_edges.end(), edge) == impl->_edges.end())
+	{
+		impl->_edges.push_back(edge);
+	}
+}
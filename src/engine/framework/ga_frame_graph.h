@@ -0,0 +1,74 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "jobs/ga_job_graph.h"
+
+#include <cstdint>
+
+/*
+** Frame state that stages read and write.
+*/
+enum ga_frame_resource_t
+{
+	// Time, buttons and mouse, from the input stage.
+	k_frame_resource_input = 1 << 0,
+
+	// The view matrix.
+	k_frame_resource_view = 1 << 1,
+
+	// Entity transforms and component state.
+	k_frame_resource_entities = 1 << 2,
+
+	// Drawcall lists.
+	k_frame_resource_static_drawcalls = 1 << 3,
+	k_frame_resource_dynamic_drawcalls = 1 << 4,
+	k_frame_resource_gui_drawcalls = 1 << 5,
+};
+
+typedef void (*ga_frame_stage_function_t)(void* data, struct ga_frame_params* params);
+
+/*
+** Schedules the stages of a frame from what each one reads and writes.
+** A stage waits for the last stage added before it that writes anything it
+** reads, and for every earlier stage that touches anything it writes.
+** Everything else overlaps, so stages only run in the order they were added
+** where the data demands it.
+**
+** The graph is built once and run every frame, each time on that frame's
+** params. It must not be changed or run again until the previous run has
+** finished.
+*/
+class ga_frame_graph
+{
+public:
+	ga_frame_graph();
+	~ga_frame_graph();
+
+	/* Adds a stage, returning its index. Resources are ga_frame_resource_t bits. */
+	int add_stage(
+		const char* name,
+		ga_frame_stage_function_t entry,
+		void* data,
+		uint32_t reads,
+		uint32_t writes,
+		ga_job_priority_t priority = k_job_priority_normal);
+
+	/* Starts every stage on params. The counter reaches zero once they've all finished. */
+	void run(struct ga_frame_params* params, ga_job_counter_t* counter);
+
+	int get_stage_count() const;
+
+private:
+	ga_frame_graph(const ga_frame_graph&) = delete;
+	ga_frame_graph& operator=(const ga_frame_graph&) = delete;
+
+	void* _impl;
+};
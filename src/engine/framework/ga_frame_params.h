@@ -10,6 +10,8 @@
 */
 
 #include "ga_drawcall.h"
+#include "ga_frame_allocator.h"
+#include "jobs/ga_job_sync.h"
 #include "math/ga_mat4f.h"
 
 #include <atomic>
@@ -61,6 +63,19 @@ enum ga_button_t
 */
 struct ga_frame_params
 {
+	explicit ga_frame_params(ga_frame_allocator* allocator = nullptr) :
+		_allocator(allocator),
+		_static_drawcalls(allocator),
+		_dynamic_drawcalls(allocator),
+		_gui_drawcalls(allocator)
+	{
+	}
+
+	// Memory for anything that only has to last until the frame is drawn.
+	// Null when the frame has no allocator, in which case the drawcall
+	// lists use the heap.
+	ga_frame_allocator* _allocator;
+
 	// Data emitted by input stage:
 	std::chrono::high_resolution_clock::time_point _current_time;
 	std::chrono::high_resolution_clock::duration _delta_time;
@@ -73,14 +88,14 @@ struct ga_frame_params
 	float _mouse_y;
 
 	// Data emitted by sim stage:
-	std::vector<ga_static_drawcall> _static_drawcalls;
-	std::atomic_flag _static_drawcall_lock = ATOMIC_FLAG_INIT;
+	ga_frame_vector<ga_static_drawcall> _static_drawcalls;
+	ga_job_mutex _static_drawcall_lock;
 
-	std::vector<ga_dynamic_drawcall> _dynamic_drawcalls;
-	std::atomic_flag _dynamic_drawcall_lock = ATOMIC_FLAG_INIT;
+	ga_frame_vector<ga_dynamic_drawcall> _dynamic_drawcalls;
+	ga_job_mutex _dynamic_drawcall_lock;
 
-	std::vector<ga_dynamic_drawcall> _gui_drawcalls;
-	std::atomic_flag _gui_drawcall_lock = ATOMIC_FLAG_INIT;
+	ga_frame_vector<ga_dynamic_drawcall> _gui_drawcalls;
+	ga_job_mutex _gui_drawcall_lock;
 
 	ga_mat4f _view;
 
@@ -0,0 +1,89 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_linear_allocator.h"
+
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+ga_linear_allocator::ga_linear_allocator(size_t block_size) :
+	_first(0),
+	_current(0),
+	_offset(0),
+	_block_size(block_size),
+	_used(0)
+{
+}
+
+ga_linear_allocator::~ga_linear_allocator()
+{
+	block_t* block = _first;
+	while (block)
+	{
+		block_t* next = block->_next;
+		::operator delete(block);
+		block = next;
+	}
+}
+
+void* ga_linear_allocator::allocate(size_t size, size_t align)
+{
+	assert(align > 0 && (align & (align - 1)) == 0);
+
+	// Try the current block, then the ones after it kept from earlier frames.
+	block_t* previous = 0;
+	block_t* block = _current;
+	size_t offset = _offset;
+	while (block)
+	{
+		uintptr_t data = uintptr_t(block + 1);
+		uintptr_t start = (data + offset + align - 1) & ~uintptr_t(align - 1);
+		if (start + size <= data + block->_size)
+		{
+			_current = block;
+			_offset = size_t(start - data) + size;
+			_used += size;
+			return reinterpret_cast<void*>(start);
+		}
+
+		previous = block;
+		block = block->_next;
+		offset = 0;
+	}
+
+	// Nothing kept is big enough, so chain on a new block. Oversized requests get one to themselves.
+	size_t block_size = size + align > _block_size ? size + align : _block_size;
+	block = static_cast<block_t*>(::operator new(sizeof(block_t) + block_size));
+	block->_next = 0;
+	block->_size = block_size;
+
+	if (previous)
+	{
+		previous->_next = block;
+	}
+	else
+	{
+		_first = block;
+	}
+
+	uintptr_t data = uintptr_t(block + 1);
+	uintptr_t start = (data + align - 1) & ~uintptr_t(align - 1);
+	_current = block;
+	_offset = size_t(start - data) + size;
+	_used += size;
+	return reinterpret_cast<void*>(start);
+}
+
+void ga_linear_allocator::reset()
+{
+	_current = _first;
+	_offset = 0;
+	_used = 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include <cstddef>
+
+/*
+** Hands out memory by bumping a pointer through a chain of blocks.
+** Nothing is freed individually; reset frees everything at once and keeps
+** the blocks for next time, so once it has grown to fit a typical workload
+** it stops touching the heap. Only one thread may use it at a time.
+*/
+class ga_linear_allocator
+{
+public:
+	explicit ga_linear_allocator(size_t block_size);
+	~ga_linear_allocator();
+
+	void* allocate(size_t size, size_t align);
+
+	void reset();
+
+	/* Bytes handed out since the last reset. */
+	size_t get_used() const { return _used; }
+
+private:
+	ga_linear_allocator(const ga_linear_allocator&) = delete;
+	ga_linear_allocator& operator=(const ga_linear_allocator&) = delete;
+
+	struct block_t
+	{
+		block_t* _next;
+		size_t _size;
+	};
+
+	block_t* _first;
+	block_t* _current;
+	size_t _offset;
+	size_t _block_size;
+	size_t _used;
+};
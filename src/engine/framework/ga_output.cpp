@@ -15,6 +15,7 @@
 #include "graphics/ga_program.h"
 #include "math/ga_mat4f.h"
 #include "math/ga_quatf.h"
+#include "math/ga_quantize.h"
 
 #include <cassert>
 #include <iostream>
@@ -85,20 +86,32 @@ void ga_output::update(ga_frame_params* params)
 	SDL_GL_SwapWindow(static_cast<SDL_Window* >(_window));
 }
 
-void ga_output::draw_dynamic(const std::vector<ga_dynamic_drawcall>& drawcalls, const ga_mat4f& view_proj)
+void ga_output::draw_dynamic(const ga_frame_vector<ga_dynamic_drawcall>& drawcalls, const ga_mat4f& view_proj)
 {
+	std::vector<ga_vec3f> unpacked_positions;
+	std::vector<ga_vec3f> unpacked_normals;
+
 	for (auto& d : drawcalls)
 	{
-		if (d._material)
+		bool packed = !d._packed_positions.empty();
+		const ga_vec3f* positions = d._positions.empty() ? nullptr : &d._positions[0];
+		size_t position_count = d._positions.size();
+		const ga_vec3f* normals = d._normals.empty() ? nullptr : &d._normals[0];
+		size_t normal_count = d._normals.size();
+
+		ga_material* material = d._material ? d._material : _default_material;
+		material->set_color(d._color);
+		if (!material->set_vertex_packing(packed, d._position_min, d._position_extent))
 		{
-			d._material->set_color(d._color);
-			d._material->bind(view_proj, d._transform);
-		}
-		else
-		{
-			_default_material->set_color(d._color);
-			_default_material->bind(view_proj, d._transform);
+			// The material can't decode compact streams, so hand it full precision ones.
+			unpack_vertices(d, unpacked_positions, unpacked_normals);
+			packed = false;
+			positions = &unpacked_positions[0];
+			position_count = unpacked_positions.size();
+			normals = unpacked_normals.empty() ? nullptr : &unpacked_normals[0];
+			normal_count = unpacked_normals.size();
 		}
+		material->bind(view_proj, d._transform);
 
 		GLuint vao;
 		glGenVertexArrays(1, &vao);
@@ -107,8 +120,16 @@ void ga_output::draw_dynamic(const std::vector<ga_dynamic_drawcall>& drawcalls,
 		GLuint pos;
 		glGenBuffers(1, &pos);
 		glBindBuffer(GL_ARRAY_BUFFER, pos);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(ga_vec3f) * d._positions.size(), &d._positions[0], GL_STREAM_DRAW);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		if (packed)
+		{
+			glBufferData(GL_ARRAY_BUFFER, sizeof(uint16_t) * d._packed_positions.size(), &d._packed_positions[0], GL_STREAM_DRAW);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0, 0);
+		}
+		else
+		{
+			glBufferData(GL_ARRAY_BUFFER, sizeof(ga_vec3f) * position_count, positions, GL_STREAM_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+		}
 		glEnableVertexAttribArray(0);
 
 		GLuint texcoord;
@@ -122,12 +143,21 @@ void ga_output::draw_dynamic(const std::vector<ga_dynamic_drawcall>& drawcalls,
 		}
 
 		GLuint norms;
-		if (!d._normals.empty())
+		bool has_normals = packed ? !d._packed_normals.empty() : normal_count > 0;
+		if (has_normals)
 		{
 			glGenBuffers(1, &norms);
 			glBindBuffer(GL_ARRAY_BUFFER, norms);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(ga_vec3f) * d._normals.size(), &d._normals[0], GL_STREAM_DRAW);
-			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
+			if (packed)
+			{
+				glBufferData(GL_ARRAY_BUFFER, sizeof(int16_t) * d._packed_normals.size(), &d._packed_normals[0], GL_STREAM_DRAW);
+				glVertexAttribPointer(2, 2, GL_SHORT, GL_TRUE, 0, 0);
+			}
+			else
+			{
+				glBufferData(GL_ARRAY_BUFFER, sizeof(ga_vec3f) * normal_count, normals, GL_STREAM_DRAW);
+				glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
+			}
 			glEnableVertexAttribArray(2);
 		}
 
@@ -146,7 +176,7 @@ void ga_output::draw_dynamic(const std::vector<ga_dynamic_drawcall>& drawcalls,
 		{
 			glDeleteBuffers(1, &texcoord);
 		}
-		if (!d._normals.empty())
+		if (has_normals)
 		{
 			glDeleteBuffers(1, &norms);
 		}
@@ -155,3 +185,23 @@ void ga_output::draw_dynamic(const std::vector<ga_dynamic_drawcall>& drawcalls,
 		glBindVertexArray(0);
 	}
 }
+
+void ga_output::unpack_vertices(const ga_dynamic_drawcall& drawcall, std::vector<ga_vec3f>& positions, std::vector<ga_vec3f>& normals)
+{
+	size_t count = drawcall._packed_positions.size() / 3;
+	positions.resize(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (int a = 0; a < 3; ++a)
+		{
+			float value = drawcall._packed_positions[i * 3 + a] / 65535.0f;
+			positions[i].axes[a] = drawcall._position_min.axes[a] + value * drawcall._position_extent.axes[a];
+		}
+	}
+
+	normals.resize(drawcall._packed_normals.size() / 2);
+	for (size_t i = 0; i < normals.size(); ++i)
+	{
+		normals[i] = ga_decode_octahedral(&drawcall._packed_normals[i * 2]);
+	}
+}
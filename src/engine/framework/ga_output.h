@@ -10,6 +10,7 @@
 */
 
 #include "ga_drawcall.h"
+#include "ga_frame_allocator.h"
 #include "math/ga_mat4f.h"
 
 #include <vector>
@@ -27,7 +28,10 @@ public:
 	void update(struct ga_frame_params* params);
 
 private:
-	void draw_dynamic(const std::vector<ga_dynamic_drawcall>& drawcalls, const ga_mat4f& view_proj);
+	void draw_dynamic(const ga_frame_vector<ga_dynamic_drawcall>& drawcalls, const ga_mat4f& view_proj);
+
+	/* Decodes a drawcall's compact vertex streams, for materials that can't. */
+	static void unpack_vertices(const ga_dynamic_drawcall& drawcall, std::vector<ga_vec3f>& positions, std::vector<ga_vec3f>& normals);
 
 	void* _window;
 
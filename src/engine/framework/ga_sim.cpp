@@ -14,10 +14,6 @@
 #include "entity/ga_entity.h"
 #include "jobs/ga_job.h"
 
-#if defined(GA_MINGW)
-#include <malloc.h>
-#endif
-
 ga_sim::ga_sim()
 {
 }
@@ -33,64 +29,48 @@ void ga_sim::add_entity(ga_entity* ent)
 
 void ga_sim::update(ga_frame_params* params)
 {
-	// Create jobs that update all entities in parallel (one job per entity).
-	// There are 2 components:
-	// 1. The job declarations; a function and a pointer to data for that function.
-	// 2. The data for each job; an entity and the frame_params.
-
-	auto decls = static_cast<ga_job_decl_t*>(alloca(sizeof(ga_job_decl_t) * _entities.size()));
-
-	struct update_data_t
-	{
-		ga_entity* _entity;
-		ga_frame_params* _params;
-	};
-	auto update_data = static_cast<update_data_t*>(alloca(sizeof(update_data_t) * _entities.size()));
-
-	for (int i = 0; i < _entities.size(); ++i)
+	// Update all entities in parallel, one job per entity.
+	ga_job::parallel_for(0, int(_entities.size()), 1, [this, params](int i)
 	{
-		update_data[i]._entity = _entities[i];
-		update_data[i]._params = params;
-
-		decls[i]._data = update_data + i;
-		decls[i]._entry = [](void* data)
-		{
-			auto update_data = static_cast<update_data_t*>(data);
-			update_data->_entity->update(update_data->_params);
-		};
-	}
-
-	// Dispatch the jobs:
-	int32_t update_counter;
-	ga_job::run(decls, int(_entities.size()), &update_counter);
-	ga_job::wait(&update_counter);
+		_entities[i]->update(params);
+	});
 }
 
 void ga_sim::late_update(ga_frame_params* params)
 {
-	auto decls = static_cast<ga_job_decl_t*>(alloca(sizeof(ga_job_decl_t) * _entities.size()));
-
-	struct update_data_t
+	ga_job::parallel_for(0, int(_entities.size()), 1, [this, params](int i)
 	{
-		ga_entity* _entity;
-		ga_frame_params* _params;
-	};
-	auto update_data = static_cast<update_data_t*>(alloca(sizeof(update_data_t) * _entities.size()));
+		_entities[i]->late_update(params);
+	});
+}
+
+void ga_sim::update_overlapped(ga_frame_params* params)
+{
+	_update_data.resize(_entities.size());
+	_update_graph.clear();
 
+	// Entity updates gate the frame, so they go ahead of any bulk work.
 	for (int i = 0; i < _entities.size(); ++i)
 	{
-		update_data[i]._entity = _entities[i];
-		update_data[i]._params = params;
+		_update_data[i]._entity = _entities[i];
+		_update_data[i]._params = params;
 
-		decls[i]._data = update_data + i;
-		decls[i]._entry = [](void* data)
+		int update = _update_graph.add([](void* data)
+		{
+			auto update_data = static_cast<update_data_t*>(data);
+			update_data->_entity->update(update_data->_params);
+		}, &_update_data[i], k_job_priority_high, "entity update");
+
+		int late_update = _update_graph.add([](void* data)
 		{
 			auto update_data = static_cast<update_data_t*>(data);
 			update_data->_entity->late_update(update_data->_params);
-		};
+		}, &_update_data[i], k_job_priority_high, "entity late update");
+
+		_update_graph.add_dependency(update, late_update);
 	}
 
-	int32_t update_counter;
-	ga_job::run(decls, int(_entities.size()), &update_counter);
+	ga_job_counter_t update_counter;
+	_update_graph.run(&update_counter);
 	ga_job::wait(&update_counter);
 }
@@ -9,6 +9,8 @@
 ** This file is distributed under the MIT License. See LICENSE.txt.
 */
 
+#include "jobs/ga_job_graph.h"
+
 #include <vector>
 
 /*
@@ -26,6 +28,21 @@ public:
 	void update(struct ga_frame_params* params);
 	void late_update(struct ga_frame_params* params);
 
+	/*
+	** Runs update then late update on every entity. Each entity's late update
+	** only waits for its own update, not for every entity's, so fast entities
+	** don't sit behind slow ones.
+	*/
+	void update_overlapped(struct ga_frame_params* params);
+
 private:
 	std::vector<class ga_entity*> _entities;
+
+	struct update_data_t
+	{
+		class ga_entity* _entity;
+		struct ga_frame_params* _params;
+	};
+	ga_job_graph _update_graph;
+	std::vector<update_data_t> _update_data;
 };
@@ -186,7 +186,7 @@ void ga_cube_component::update(ga_frame_params* params)
 	draw._draw_mode = GL_TRIANGLES;
 	draw._material = _material;
 
-	while (params->_static_drawcall_lock.test_and_set(std::memory_order_acquire)) {}
+	params->_static_drawcall_lock.lock();
 	params->_static_drawcalls.push_back(draw);
-	params->_static_drawcall_lock.clear(std::memory_order_release);
+	params->_static_drawcall_lock.unlock();
 }
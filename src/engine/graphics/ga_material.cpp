@@ -209,6 +209,14 @@ void ga_phong_color_material::set_back_material_info(ga_vec3f ambient_reflect, g
 	back_mat_info.Shininess = shine;
 }
 
+bool ga_phong_color_material::set_vertex_packing(bool packed, const ga_vec3f& position_min, const ga_vec3f& position_extent)
+{
+	_packed = packed;
+	_position_min = position_min;
+	_position_extent = position_extent;
+	return true;
+}
+
 void ga_phong_color_material::bind(const ga_mat4f& view_proj, const ga_mat4f& transform)
 {
 	ga_uniform mvp_uniform = _program->get_uniform("u_mvp");
@@ -226,6 +234,10 @@ void ga_phong_color_material::bind(const ga_mat4f& view_proj, const ga_mat4f& tr
 	ga_uniform back_mat_diff_uniform = _program->get_uniform("BackMaterialDiffuse");
 	ga_uniform back_mat_spec_uniform = _program->get_uniform("BackMaterialSpecular");
 
+	ga_uniform packed_uniform = _program->get_uniform("u_packed");
+	ga_uniform position_min_uniform = _program->get_uniform("u_position_min");
+	ga_uniform position_extent_uniform = _program->get_uniform("u_position_extent");
+
 	_program->use();
 
 	mvp_uniform.set(transform * view_proj);
@@ -242,6 +254,10 @@ void ga_phong_color_material::bind(const ga_mat4f& view_proj, const ga_mat4f& tr
 	back_mat_diff_uniform.set(back_mat_info.Kd);
 	back_mat_spec_uniform.set(back_mat_info.Ks);
 
+	packed_uniform.set(_packed);
+	position_min_uniform.set(_position_min);
+	position_extent_uniform.set(_position_extent);
+
 	glDisable(GL_BLEND);
 	glEnable(GL_DEPTH_TEST);
 	glDepthMask(GL_TRUE);
@@ -30,6 +30,11 @@ public:
 
 	virtual void set_color(const ga_vec3f& color) {}
 
+	/*
+	** Says whether drawcalls use compact vertex streams. Returns false if the
+	** material can't draw them, in which case they must be unpacked first.
+	*/
+	virtual bool set_vertex_packing(bool packed, const ga_vec3f& position_min, const ga_vec3f& position_extent) { return !packed; }
 };
 
 /*
@@ -96,6 +101,8 @@ public:
 
 	void set_light_pos(ga_vec3f lp) { light_info.Position = lp; }
 
+	virtual bool set_vertex_packing(bool packed, const ga_vec3f& position_min, const ga_vec3f& position_extent) override;
+
 private:
 	struct LightInfo
 	{
@@ -115,6 +122,11 @@ private:
 
 	struct MaterialInfo back_mat_info;
 
+	// dequantization for compact vertex streams
+	bool _packed = false;
+	ga_vec3f _position_min;
+	ga_vec3f _position_extent;
+
 	ga_shader* _vs;
 	ga_shader* _fs;
 	ga_program* _program;
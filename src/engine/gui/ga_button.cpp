@@ -41,7 +41,7 @@ ga_button::ga_button(const char* text, float x, float y, ga_frame_params* params
 
 		if (params->_mouse_press_mask != 0) {
 			// draw a box if the mouse is held down in the button
-			ga_dynamic_drawcall bg_drawcall;
+			ga_dynamic_drawcall bg_drawcall(params->_allocator);
 
 			bg_drawcall._positions.push_back({ top_left.x, top_left.y, 0.0f });
 			bg_drawcall._positions.push_back({ bot_right.x, top_left.y, 0.0f });
@@ -60,9 +60,9 @@ ga_button::ga_button(const char* text, float x, float y, ga_frame_params* params
 			bg_drawcall._transform.make_identity();
 			bg_drawcall._material = nullptr;
 
-			while (params->_gui_drawcall_lock.test_and_set(std::memory_order_acquire)) {}
-			params->_gui_drawcalls.push_back(bg_drawcall);
-			params->_gui_drawcall_lock.clear(std::memory_order_release);
+			params->_gui_drawcall_lock.lock();
+			params->_gui_drawcalls.push_back(std::move(bg_drawcall));
+			params->_gui_drawcall_lock.unlock();
 
 			// re-draw text over colored box
 			g_font->print(params, text, x, y, text_color, &top_left, &bot_right);
@@ -38,7 +38,7 @@ ga_checkbox::ga_checkbox(bool state, const char* text, float x, float y, ga_fram
 	// draw X if box is active
 	if (state)
 	{
-		ga_dynamic_drawcall x_drawcall;
+		ga_dynamic_drawcall x_drawcall(params->_allocator);
 
 		x_drawcall._positions.push_back({ _left_x, _upper_y, 0.0f });
 		x_drawcall._positions.push_back({ _right_x, _upper_y, 0.0f });
@@ -64,9 +64,9 @@ ga_checkbox::ga_checkbox(bool state, const char* text, float x, float y, ga_fram
 		x_drawcall._transform.make_identity();
 		x_drawcall._material = nullptr;
 
-		while (params->_gui_drawcall_lock.test_and_set(std::memory_order_acquire)) {}
-		params->_gui_drawcalls.push_back(x_drawcall);
-		params->_gui_drawcall_lock.clear(std::memory_order_release);
+		params->_gui_drawcall_lock.lock();
+		params->_gui_drawcalls.push_back(std::move(x_drawcall));
+		params->_gui_drawcall_lock.unlock();
 	}
 
 	// draw the text
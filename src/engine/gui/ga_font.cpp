@@ -94,7 +94,7 @@ void ga_font::print(
 		*max = { x, y };
 	}
 
-	ga_dynamic_drawcall drawcall;
+	ga_dynamic_drawcall drawcall(params->_allocator);
 	drawcall._color = color;
 	drawcall._draw_mode = GL_TRIANGLES;
 	drawcall._material = _material;
@@ -140,9 +140,9 @@ void ga_font::print(
 		++text;
 	}
 
-	while (params->_gui_drawcall_lock.test_and_set(std::memory_order_acquire)) {}
-	params->_gui_drawcalls.push_back(drawcall);
-	params->_gui_drawcall_lock.clear(std::memory_order_release);
+	params->_gui_drawcall_lock.lock();
+	params->_gui_drawcalls.push_back(std::move(drawcall));
+	params->_gui_drawcall_lock.unlock();
 }
 
 ga_font_material::ga_font_material(ga_texture* texture) : _texture(texture)
@@ -11,7 +11,7 @@
 
 void ga_widget::draw_box(float left_x, float right_x, float top_y, float bottom_y, ga_vec3f color, struct ga_frame_params* params)
 {
-	ga_dynamic_drawcall drawcall;
+	ga_dynamic_drawcall drawcall(params->_allocator);
 
 	drawcall._positions.push_back({ left_x, top_y, 0.0f });
 	drawcall._positions.push_back({ right_x, top_y, 0.0f });
@@ -32,7 +32,7 @@ void ga_widget::draw_box(float left_x, float right_x, float top_y, float bottom_
 	drawcall._transform.make_identity();
 	drawcall._material = nullptr;
 
-	while (params->_gui_drawcall_lock.test_and_set(std::memory_order_acquire)) {}
-	params->_gui_drawcalls.push_back(drawcall);
-	params->_gui_drawcall_lock.clear(std::memory_order_release);
+	params->_gui_drawcall_lock.lock();
+	params->_gui_drawcalls.push_back(std::move(drawcall));
+	params->_gui_drawcall_lock.unlock();
 }
\ No newline at end of file
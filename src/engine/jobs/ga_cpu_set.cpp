@@ -0,0 +1,370 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_cpu_set.h"
+
+#include "framework/ga_compiler_defines.h"
+
+#include <mutex>
+#include <thread>
+
+#if defined(GA_MSVC)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#elif defined(GA_LINUX)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#endif
+
+ga_cpu_set::ga_cpu_set()
+{
+}
+
+ga_cpu_set ga_cpu_set::all()
+{
+	return ga_cpu_topology::get_allowed_cpus();
+}
+
+ga_cpu_set ga_cpu_set::from_mask(uint64_t mask)
+{
+	ga_cpu_set cpus;
+	int cpu_count = ga_cpu_topology::get_cpu_count();
+	for (int cpu = 0; cpu < cpu_count && cpu < 64; ++cpu)
+	{
+		if ((mask & (1ull << cpu)) != 0)
+		{
+			cpus.set(cpu);
+		}
+	}
+	return cpus;
+}
+
+void ga_cpu_set::set(int cpu)
+{
+	size_t word = (size_t)cpu / 64;
+	if (word >= _words.size())
+	{
+		_words.resize(word + 1, 0);
+	}
+	_words[word] |= 1ull << (cpu % 64);
+}
+
+void ga_cpu_set::clear(int cpu)
+{
+	size_t word = (size_t)cpu / 64;
+	if (word < _words.size())
+	{
+		_words[word] &= ~(1ull << (cpu % 64));
+	}
+}
+
+bool ga_cpu_set::is_set(int cpu) const
+{
+	size_t word = (size_t)cpu / 64;
+	return word < _words.size() && (_words[word] & (1ull << (cpu % 64))) != 0;
+}
+
+int ga_cpu_set::get_count() const
+{
+	int count = 0;
+	for (uint64_t word : _words)
+	{
+		for (; word; word &= word - 1)
+		{
+			++count;
+		}
+	}
+	return count;
+}
+
+int ga_cpu_set::get_size() const
+{
+	return (int)_words.size() * 64;
+}
+
+/*
+** The NUMA node of each hardware thread, read once.
+*/
+static std::vector<int> g_cpu_numa_nodes;
+static int g_numa_node_count = 1;
+static std::once_flag g_topology_once;
+
+#if defined(GA_LINUX)
+
+/*
+** Parses a sysfs cpu list such as "0-15,32-47".
+*/
+static void _ga_cpu_parse_list(const char* list, int node)
+{
+	while (*list)
+	{
+		char* end;
+		long first = strtol(list, &end, 10);
+		if (end == list)
+		{
+			break;
+		}
+
+		long last = first;
+		if (*end == '-')
+		{
+			list = end + 1;
+			last = strtol(list, &end, 10);
+		}
+
+		for (long cpu = first; cpu <= last && cpu < (long)g_cpu_numa_nodes.size(); ++cpu)
+		{
+			g_cpu_numa_nodes[cpu] = node;
+		}
+
+		list = *end == ',' ? end + 1 : end;
+		if (*list == '\n')
+		{
+			break;
+		}
+	}
+}
+
+static void _ga_cpu_read_topology()
+{
+	g_cpu_numa_nodes.assign(ga_cpu_topology::get_cpu_count(), 0);
+
+	DIR* nodes = opendir("/sys/devices/system/node");
+	if (!nodes)
+	{
+		return;
+	}
+
+	int node_count = 0;
+	while (dirent* entry = readdir(nodes))
+	{
+		int node;
+		if (sscanf(entry->d_name, "node%d", &node) != 1)
+		{
+			continue;
+		}
+
+		char path[sizeof("/sys/devices/system/node/") + sizeof(entry->d_name) + sizeof("/cpulist")];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+		FILE* file = fopen(path, "r");
+		if (!file)
+		{
+			continue;
+		}
+
+		char list[4096];
+		if (fgets(list, sizeof(list), file))
+		{
+			_ga_cpu_parse_list(list, node);
+			node_count = node + 1 > node_count ? node + 1 : node_count;
+		}
+		fclose(file);
+	}
+	closedir(nodes);
+
+	g_numa_node_count = node_count > 0 ? node_count : 1;
+}
+
+int ga_cpu_topology::get_cpu_count()
+{
+	long count = sysconf(_SC_NPROCESSORS_CONF);
+	return count > 0 ? (int)count : (int)std::thread::hardware_concurrency();
+}
+
+ga_cpu_set ga_cpu_topology::get_allowed_cpus()
+{
+	int cpu_count = get_cpu_count();
+	cpu_set_t* set = CPU_ALLOC(cpu_count);
+	size_t set_size = CPU_ALLOC_SIZE(cpu_count);
+	CPU_ZERO_S(set_size, set);
+	bool known = sched_getaffinity(0, set_size, set) == 0;
+
+	ga_cpu_set cpus;
+	for (int cpu = 0; cpu < cpu_count; ++cpu)
+	{
+		if (!known || CPU_ISSET_S(cpu, set_size, set))
+		{
+			cpus.set(cpu);
+		}
+	}
+	CPU_FREE(set);
+	return cpus;
+}
+
+int ga_cpu_topology::get_current_cpu()
+{
+	return sched_getcpu();
+}
+
+bool ga_cpu_topology::pin_current_thread(int cpu)
+{
+	/* Sized at run time so machines past CPU_SETSIZE work too. */
+	int cpu_count = get_cpu_count();
+	if (cpu < 0 || cpu >= cpu_count)
+	{
+		return false;
+	}
+
+	cpu_set_t* set = CPU_ALLOC(cpu_count);
+	size_t set_size = CPU_ALLOC_SIZE(cpu_count);
+	CPU_ZERO_S(set_size, set);
+	CPU_SET_S(cpu, set_size, set);
+	bool pinned = pthread_setaffinity_np(pthread_self(), set_size, set) == 0;
+	CPU_FREE(set);
+	return pinned;
+}
+
+#elif defined(GA_MSVC)
+
+/*
+** Windows numbers hardware threads within processor groups of up to 64.
+*/
+static bool _ga_cpu_to_processor(int cpu, PROCESSOR_NUMBER* processor)
+{
+	WORD group_count = GetActiveProcessorGroupCount();
+	for (WORD group = 0; group < group_count; ++group)
+	{
+		int group_size = (int)GetActiveProcessorCount(group);
+		if (cpu < group_size)
+		{
+			processor->Group = group;
+			processor->Number = (BYTE)cpu;
+			processor->Reserved = 0;
+			return true;
+		}
+		cpu -= group_size;
+	}
+	return false;
+}
+
+static void _ga_cpu_read_topology()
+{
+	int cpu_count = ga_cpu_topology::get_cpu_count();
+	g_cpu_numa_nodes.assign(cpu_count, 0);
+
+	int node_count = 0;
+	for (int cpu = 0; cpu < cpu_count; ++cpu)
+	{
+		PROCESSOR_NUMBER processor;
+		USHORT node;
+		if (_ga_cpu_to_processor(cpu, &processor) && GetNumaProcessorNodeEx(&processor, &node) && node != 0xffff)
+		{
+			g_cpu_numa_nodes[cpu] = node;
+			node_count = node + 1 > node_count ? node + 1 : node_count;
+		}
+	}
+
+	g_numa_node_count = node_count > 0 ? node_count : 1;
+}
+
+int ga_cpu_topology::get_cpu_count()
+{
+	return (int)GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+}
+
+ga_cpu_set ga_cpu_topology::get_allowed_cpus()
+{
+	/* The process affinity mask only covers one group, so only use it when there is one. */
+	ga_cpu_set cpus;
+	int cpu_count = get_cpu_count();
+	DWORD_PTR process_mask, system_mask;
+	bool known = GetActiveProcessorGroupCount() == 1 && GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask);
+	for (int cpu = 0; cpu < cpu_count; ++cpu)
+	{
+		if (!known || (cpu < (int)(sizeof(process_mask) * 8) && (process_mask & ((DWORD_PTR)1 << cpu)) != 0))
+		{
+			cpus.set(cpu);
+		}
+	}
+	return cpus;
+}
+
+int ga_cpu_topology::get_current_cpu()
+{
+	PROCESSOR_NUMBER processor;
+	GetCurrentProcessorNumberEx(&processor);
+
+	int cpu = processor.Number;
+	for (WORD group = 0; group < processor.Group; ++group)
+	{
+		cpu += (int)GetActiveProcessorCount(group);
+	}
+	return cpu;
+}
+
+bool ga_cpu_topology::pin_current_thread(int cpu)
+{
+	PROCESSOR_NUMBER processor;
+	if (!_ga_cpu_to_processor(cpu, &processor))
+	{
+		return false;
+	}
+
+	GROUP_AFFINITY affinity = {};
+	affinity.Group = processor.Group;
+	affinity.Mask = (KAFFINITY)1 << processor.Number;
+	return SetThreadGroupAffinity(GetCurrentThread(), &affinity, 0) != 0;
+}
+
+#else
+
+/*
+** No topology information on this platform. Everything is one node and
+** threads are left wherever the OS puts them.
+*/
+static void _ga_cpu_read_topology()
+{
+	g_cpu_numa_nodes.assign(ga_cpu_topology::get_cpu_count(), 0);
+}
+
+int ga_cpu_topology::get_cpu_count()
+{
+	return (int)std::thread::hardware_concurrency();
+}
+
+ga_cpu_set ga_cpu_topology::get_allowed_cpus()
+{
+	ga_cpu_set cpus;
+	int cpu_count = get_cpu_count();
+	for (int cpu = 0; cpu < cpu_count; ++cpu)
+	{
+		cpus.set(cpu);
+	}
+	return cpus;
+}
+
+int ga_cpu_topology::get_current_cpu()
+{
+	return -1;
+}
+
+bool ga_cpu_topology::pin_current_thread(int cpu)
+{
+	(void)cpu;
+	return false;
+}
+
+#endif
+
+int ga_cpu_topology::get_numa_node_count()
+{
+	std::call_once(g_topology_once, _ga_cpu_read_topology);
+	return g_numa_node_count;
+}
+
+int ga_cpu_topology::get_numa_node(int cpu)
+{
+	std::call_once(g_topology_once, _ga_cpu_read_topology);
+	return cpu >= 0 && cpu < (int)g_cpu_numa_nodes.size() ? g_cpu_numa_nodes[cpu] : 0;
+}
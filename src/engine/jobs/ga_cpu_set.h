@@ -0,0 +1,65 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include <cstdint>
+#include <vector>
+
+/*
+** A set of hardware threads, of any width.
+** Hardware threads are numbered from zero across the whole machine. On
+** Windows the numbering runs through each processor group in turn.
+*/
+class ga_cpu_set
+{
+public:
+	ga_cpu_set();
+
+	/* Every hardware thread the process may run on. */
+	static ga_cpu_set all();
+
+	/* The hardware threads picked by a bit mask, up to the machine's count. */
+	static ga_cpu_set from_mask(uint64_t mask);
+
+	void set(int cpu);
+	void clear(int cpu);
+	bool is_set(int cpu) const;
+
+	/* Number of hardware threads in the set. */
+	int get_count() const;
+
+	/* One past the highest hardware thread that could be in the set. */
+	int get_size() const;
+
+private:
+	std::vector<uint64_t> _words;
+};
+
+/*
+** Hardware thread and NUMA node layout of the machine.
+*/
+class ga_cpu_topology
+{
+public:
+	/* Hardware threads on the machine, whether or not the process may use them. */
+	static int get_cpu_count();
+
+	/* The hardware threads the process's affinity allows it to run on. */
+	static ga_cpu_set get_allowed_cpus();
+
+	static int get_numa_node_count();
+	static int get_numa_node(int cpu);
+
+	/* The hardware thread the caller is running on right now, or -1. */
+	static int get_current_cpu();
+
+	/* Keeps the calling thread on one hardware thread. */
+	static bool pin_current_thread(int cpu);
+};
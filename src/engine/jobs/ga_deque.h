@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+/*
+** Fixed capacity work-stealing deque.
+** The owning thread pushes and pops at the bottom, any other thread may steal
+** from the top.
+** https://www.di.ens.fr/~zappa/readings/ppopp13.pdf
+*/
+class ga_deque
+{
+public:
+	ga_deque(int capacity);
+	~ga_deque();
+
+	/* Owner only. Push fails if the deque is full. */
+	bool push(void* data);
+	bool pop(void** data);
+
+	/* Owner only. Pushes as many as fit, returning how many that was. */
+	int push_batch(void* const* data, int count);
+
+	/* Any thread. */
+	bool steal(void** data);
+
+	int get_count() const;
+
+private:
+	void* _impl;
+};
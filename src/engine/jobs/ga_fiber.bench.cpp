@@ -0,0 +1,65 @@
+/**
+* Benchmark for fiber context switches.
+* Ping-pongs between the thread's own fiber and a second fiber and reports
+* the average cost of a single switch.
+*
+* Usage: ga_fiber_bench [round trips]
+**/
+
+#include "ga_fiber.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+struct ping_pong_t
+{
+	ga_fiber* _thread_fiber;
+	volatile uint64_t _count;
+};
+
+static void ping_pong_worker(void* data)
+{
+	ping_pong_t* state = static_cast<ping_pong_t*>(data);
+	for (;;)
+	{
+		state->_count++;
+		ga_fiber::switch_to(*state->_thread_fiber);
+	}
+}
+
+int main(int argc, const char** argv)
+{
+	uint64_t round_trips = argc > 1 ? strtoull(argv[1], 0, 10) : 10000000;
+
+	ping_pong_t state;
+	state._count = 0;
+
+	ga_fiber thread_fiber = ga_fiber::convert_thread(&state);
+	ga_fiber worker(ping_pong_worker, &state, 64 * 1024);
+	state._thread_fiber = &thread_fiber;
+
+	// warm up the stack and branch predictors
+	for (int i = 0; i < 1000; ++i)
+	{
+		ga_fiber::switch_to(worker);
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint64_t i = 0; i < round_trips; ++i)
+	{
+		ga_fiber::switch_to(worker);
+	}
+	double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(
+		std::chrono::high_resolution_clock::now() - start).count();
+
+	if (state._count != round_trips + 1000)
+	{
+		printf("Fiber ran %llu times, expected %llu.\n", (unsigned long long)state._count, (unsigned long long)(round_trips + 1000));
+		return 1;
+	}
+
+	printf("%llu round trips in %.3f ms\n", (unsigned long long)round_trips, seconds * 1000.0);
+	printf("%.2f ns per switch\n", seconds * 1e9 / (round_trips * 2));
+	return 0;
+}
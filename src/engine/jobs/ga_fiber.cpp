@@ -9,24 +9,46 @@
 
 #include "ga_fiber.h"
 
+static const size_t k_stack_align = 4 * 1024;
+static const size_t k_min_stack_size = 16 * 1024;
+
+static size_t align_stack_size(size_t stack_size)
+{
+	stack_size = stack_size > k_min_stack_size ? stack_size : k_min_stack_size;
+	return (stack_size + k_stack_align - 1) & ~(k_stack_align - 1);
+}
+
+#if defined(GA_MSVC) || defined(GA_MINGW)
+
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #undef WIN32_LEAN_AND_MEAN
 
 ga_fiber::ga_fiber(function_t func, void* func_data, size_t stack_size)
 {
-	const size_t k_stack_align = 64 * 1024;
-	stack_size = stack_size > k_stack_align ? stack_size : k_stack_align;
-	stack_size = (stack_size + k_stack_align - 1) & ~(k_stack_align - 1);
-
-	_impl = CreateFiber(stack_size, (LPFIBER_START_ROUTINE)func, func_data);
+	/* Reserve the whole stack but commit one page; Windows grows it through its own guard page. */
+	_impl = CreateFiberEx(k_stack_align, align_stack_size(stack_size), FIBER_FLAG_FLOAT_SWITCH, (LPFIBER_START_ROUTINE)func, func_data);
 }
 
 ga_fiber::~ga_fiber()
+{
+	release();
+}
+
+void ga_fiber::release()
 {
 	if (_impl)
 	{
-		DeleteFiber(_impl);
+		/* Deleting the running fiber would exit the thread, so turn it back into a plain thread. */
+		if (_impl == GetCurrentFiber())
+		{
+			ConvertFiberToThread();
+		}
+		else
+		{
+			DeleteFiber(_impl);
+		}
+		_impl = 0;
 	}
 }
 
@@ -34,6 +56,7 @@ ga_fiber& ga_fiber::operator=(ga_fiber&& other)
 {
 	if (&other != this)
 	{
+		release();
 		_impl = other._impl;
 		other._impl = 0;
 	}
@@ -56,3 +79,298 @@ void* ga_fiber::get_data()
 {
 	return GetFiberData();
 }
+
+size_t ga_fiber::get_stack_high_water() const
+{
+	return 0;
+}
+
+#elif defined(GA_LINUX) && (defined(GA_X64) || defined(GA_ARM64))
+
+#include <cassert>
+#include <cstdint>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+** POSIX fibers.
+** ucontext would do the job, but swapcontext makes a sigprocmask syscall on
+** every switch. Fibers here only ever switch at a function call, so all we
+** need to keep are the callee-saved registers and the stack pointer.
+*/
+struct ga_fiber_impl_t
+{
+	/* Stack pointer saved by the last switch away from this fiber. */
+	void* _stack_pointer;
+	void* _data;
+
+	/* Stack mapping, with a guard page at the low end. Null for a converted thread. */
+	void* _stack;
+	size_t _stack_mapping_size;
+};
+
+extern "C" void ga_fiber_switch_context(void** from_stack_pointer, void* to_stack_pointer);
+extern "C" void ga_fiber_entry();
+
+#if defined(GA_X64)
+/*
+** System V x86-64.
+** Pushes rbp, rbx, r12-r15 and the SSE and x87 control words, then swaps
+** stacks. A new fiber's stack is laid out so the first switch "returns" into
+** ga_fiber_entry with the function in r12 and its data in r13.
+*/
+__asm__(
+	".text\n"
+	".globl ga_fiber_switch_context\n"
+	".type ga_fiber_switch_context, @function\n"
+	".align 16\n"
+	"ga_fiber_switch_context:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	subq $8, %rsp\n"
+	"	stmxcsr (%rsp)\n"
+	"	fnstcw 4(%rsp)\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rsp\n"
+	"	ldmxcsr (%rsp)\n"
+	"	fldcw 4(%rsp)\n"
+	"	addq $8, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size ga_fiber_switch_context, .-ga_fiber_switch_context\n"
+
+	".globl ga_fiber_entry\n"
+	".type ga_fiber_entry, @function\n"
+	".align 16\n"
+	"ga_fiber_entry:\n"
+	"	movq %r13, %rdi\n"
+	"	callq *%r12\n"
+	"	ud2\n"
+	".size ga_fiber_entry, .-ga_fiber_entry\n"
+);
+
+static void* init_stack(void* stack_top, ga_fiber::function_t func, void* func_data)
+{
+	/* ga_fiber_entry must start with a 16 byte aligned stack pointer, as if called. */
+	uint64_t* sp = (uint64_t*)((uintptr_t)stack_top & ~(uintptr_t)15);
+	*--sp = (uint64_t)(uintptr_t)ga_fiber_entry;
+	*--sp = 0;                          /* rbp */
+	*--sp = 0;                          /* rbx */
+	*--sp = (uint64_t)(uintptr_t)func;  /* r12 */
+	*--sp = (uint64_t)(uintptr_t)func_data; /* r13 */
+	*--sp = 0;                          /* r14 */
+	*--sp = 0;                          /* r15 */
+	*--sp = 0x037f00001f80ull;          /* default fpu control word and mxcsr */
+	return sp;
+}
+
+#elif defined(GA_ARM64)
+/*
+** AAPCS64.
+** Stores x19-x30 and the low halves of v8-v15, then swaps stacks. A new
+** fiber's frame has ga_fiber_entry in x30, the function in x19 and its data
+** in x20.
+*/
+__asm__(
+	".text\n"
+	".globl ga_fiber_switch_context\n"
+	".type ga_fiber_switch_context, %function\n"
+	".align 4\n"
+	"ga_fiber_switch_context:\n"
+	"	sub sp, sp, #160\n"
+	"	stp x19, x20, [sp, #0]\n"
+	"	stp x21, x22, [sp, #16]\n"
+	"	stp x23, x24, [sp, #32]\n"
+	"	stp x25, x26, [sp, #48]\n"
+	"	stp x27, x28, [sp, #64]\n"
+	"	stp x29, x30, [sp, #80]\n"
+	"	stp d8, d9, [sp, #96]\n"
+	"	stp d10, d11, [sp, #112]\n"
+	"	stp d12, d13, [sp, #128]\n"
+	"	stp d14, d15, [sp, #144]\n"
+	"	mov x2, sp\n"
+	"	str x2, [x0]\n"
+	"	mov sp, x1\n"
+	"	ldp x19, x20, [sp, #0]\n"
+	"	ldp x21, x22, [sp, #16]\n"
+	"	ldp x23, x24, [sp, #32]\n"
+	"	ldp x25, x26, [sp, #48]\n"
+	"	ldp x27, x28, [sp, #64]\n"
+	"	ldp x29, x30, [sp, #80]\n"
+	"	ldp d8, d9, [sp, #96]\n"
+	"	ldp d10, d11, [sp, #112]\n"
+	"	ldp d12, d13, [sp, #128]\n"
+	"	ldp d14, d15, [sp, #144]\n"
+	"	add sp, sp, #160\n"
+	"	ret\n"
+	".size ga_fiber_switch_context, .-ga_fiber_switch_context\n"
+
+	".globl ga_fiber_entry\n"
+	".type ga_fiber_entry, %function\n"
+	".align 4\n"
+	"ga_fiber_entry:\n"
+	"	mov x0, x20\n"
+	"	blr x19\n"
+	"	brk #0\n"
+	".size ga_fiber_entry, .-ga_fiber_entry\n"
+);
+
+static void* init_stack(void* stack_top, ga_fiber::function_t func, void* func_data)
+{
+	uint64_t* sp = (uint64_t*)(((uintptr_t)stack_top & ~(uintptr_t)15) - 160);
+	for (int i = 0; i < 20; ++i)
+	{
+		sp[i] = 0;
+	}
+	sp[0] = (uint64_t)(uintptr_t)func;              /* x19 */
+	sp[1] = (uint64_t)(uintptr_t)func_data;         /* x20 */
+	sp[11] = (uint64_t)(uintptr_t)ga_fiber_entry;   /* x30 */
+	return sp;
+}
+#endif
+
+/*
+** The fiber running on this thread.
+** Fibers move between threads, so this is only ever read through a call the
+** compiler can't inline. Otherwise it may reuse this thread's TLS address
+** after a switch that resumed the fiber on another thread.
+*/
+static thread_local ga_fiber_impl_t* t_current_fiber = 0;
+
+GA_NOINLINE static ga_fiber_impl_t* get_current_fiber()
+{
+	return t_current_fiber;
+}
+
+GA_NOINLINE static void set_current_fiber(ga_fiber_impl_t* fiber)
+{
+	t_current_fiber = fiber;
+}
+
+ga_fiber::ga_fiber(function_t func, void* func_data, size_t stack_size)
+{
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	size_t mapping_size = align_stack_size(stack_size) + page_size;
+
+	void* stack = mmap(0, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (stack == MAP_FAILED)
+	{
+		_impl = 0;
+		return;
+	}
+
+	/*
+	** Overflowing the stack faults on the guard page instead of corrupting its
+	** neighbour. The guard splits the mapping in two, which can fail once the
+	** process is out of mappings, and a stack without one isn't safe to use.
+	*/
+	if (mprotect(stack, page_size, PROT_NONE) != 0)
+	{
+		munmap(stack, mapping_size);
+		_impl = 0;
+		return;
+	}
+
+	ga_fiber_impl_t* impl = new ga_fiber_impl_t;
+	impl->_data = func_data;
+	impl->_stack = stack;
+	impl->_stack_mapping_size = mapping_size;
+	impl->_stack_pointer = init_stack((uint8_t*)stack + mapping_size, func, func_data);
+	_impl = impl;
+}
+
+ga_fiber::~ga_fiber()
+{
+	release();
+}
+
+void ga_fiber::release()
+{
+	if (_impl)
+	{
+		ga_fiber_impl_t* impl = static_cast<ga_fiber_impl_t*>(_impl);
+		if (impl->_stack)
+		{
+			munmap(impl->_stack, impl->_stack_mapping_size);
+		}
+		else if (get_current_fiber() == impl)
+		{
+			set_current_fiber(0);
+		}
+		delete impl;
+		_impl = 0;
+	}
+}
+
+ga_fiber& ga_fiber::operator=(ga_fiber&& other)
+{
+	if (&other != this)
+	{
+		release();
+		_impl = other._impl;
+		other._impl = 0;
+	}
+	return *this;
+}
+
+ga_fiber ga_fiber::convert_thread(void* data)
+{
+	ga_fiber_impl_t* impl = new ga_fiber_impl_t;
+	impl->_stack_pointer = 0;
+	impl->_data = data;
+	impl->_stack = 0;
+	impl->_stack_mapping_size = 0;
+	set_current_fiber(impl);
+
+	ga_fiber fiber;
+	fiber._impl = impl;
+	return fiber;
+}
+
+void ga_fiber::switch_to(const ga_fiber& fiber)
+{
+	ga_fiber_impl_t* from = get_current_fiber();
+	ga_fiber_impl_t* to = static_cast<ga_fiber_impl_t*>(fiber._impl);
+	assert(from && "Thread must be converted to a fiber before switching.");
+
+	set_current_fiber(to);
+	ga_fiber_switch_context(&from->_stack_pointer, to->_stack_pointer);
+}
+
+void* ga_fiber::get_data()
+{
+	return get_current_fiber()->_data;
+}
+
+size_t ga_fiber::get_stack_high_water() const
+{
+	ga_fiber_impl_t* impl = static_cast<ga_fiber_impl_t*>(_impl);
+	if (!impl || !impl->_stack)
+	{
+		return 0;
+	}
+
+	/* Fresh mappings are zero filled, so the lowest non-zero word is the deepest the stack has gone. */
+	size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	const uint64_t* bottom = (const uint64_t*)((uint8_t*)impl->_stack + page_size);
+	const uint64_t* top = (const uint64_t*)((uint8_t*)impl->_stack + impl->_stack_mapping_size);
+	const uint64_t* word = bottom;
+	while (word < top && *word == 0)
+	{
+		++word;
+	}
+	return (size_t)((const uint8_t*)top - (const uint8_t*)word);
+}
+
+#else
+#error "No fiber implementation for this platform."
+#endif
@@ -11,9 +11,7 @@
 
 #include "framework/ga_compiler_defines.h"
 
-#if defined(GA_MINGW)
-#include <sys/types.h>
-#endif
+#include <cstddef>
 
 /*
 ** A fiber object.
@@ -35,6 +33,17 @@ public:
 	static void switch_to(const ga_fiber& fiber);
 	static void* get_data();
 
+	bool is_valid() const { return _impl != 0; }
+
+	/*
+	** Most stack the fiber has ever used, in bytes, found by scanning for
+	** untouched stack. Zero where the platform can't tell.
+	*/
+	size_t get_stack_high_water() const;
+
 private:
+	/* Frees the fiber and its stack, leaving this one invalid. */
+	void release();
+
 	void* _impl;
 };
@@ -8,113 +8,62 @@
 */
 
 #include "ga_intpool.h"
+#include "ga_queue.h"
 
-#include <atomic>
+#include <cassert>
 #include <cstdint>
-
-struct ga_intpool_nodecount_t
-{
-	uint32_t _index;
-	uint32_t _count;
-};
-
-union ga_intpool_pointer_t
-{
-	std::atomic<uint64_t> _atomic;
-
-	uint64_t _entire;
-	ga_intpool_nodecount_t _part;
-
-	ga_intpool_pointer_t() {}
-	ga_intpool_pointer_t(const ga_intpool_pointer_t& other) : _entire(other._entire) {}
-};
-
-struct ga_intpool_node_t
-{
-	ga_intpool_pointer_t _next;
-};
+#include <thread>
 
 struct ga_intpool_impl_t
 {
-	int _index_count;
+	ga_intpool_impl_t(int index_count) : _index_count(index_count), _free_indices(index_count) {}
 
-	ga_intpool_pointer_t _free_list;
+	int _index_count;
 
-	ga_intpool_node_t* _nodes;
+	ga_queue _free_indices;
 };
 
-static const uint32_t k_ga_intpool_invalid_index = 0xffffffff;
-
 ga_intpool::ga_intpool(int index_count)
 {
-	auto impl = new ga_intpool_impl_t;
-
-	impl->_index_count = index_count;
-	impl->_free_list._entire = 0;
-	impl->_nodes = new ga_intpool_node_t[index_count];
+	auto impl = new ga_intpool_impl_t(index_count);
 
-	for (int i = 0; i < index_count - 1; ++i)
+	for (int i = 0; i < index_count; ++i)
 	{
-		impl->_nodes[i]._next._part._index = i + 1;
-		impl->_nodes[i]._next._part._count = 0;
+		impl->_free_indices.push(reinterpret_cast<void*>((uintptr_t)i));
 	}
-	impl->_nodes[index_count - 1]._next._part._index = k_ga_intpool_invalid_index;
-	impl->_nodes[index_count - 1]._next._part._count = 0;
 
 	_impl = impl;
 }
 
 ga_intpool::~ga_intpool()
 {
-	ga_intpool_impl_t* impl = static_cast<ga_intpool_impl_t*>(_impl);
-	delete[] impl->_nodes;
-	delete impl;
+	delete static_cast<ga_intpool_impl_t*>(_impl);
 }
 
 int ga_intpool::alloc()
 {
-	int index;
 	ga_intpool_impl_t* impl = static_cast<ga_intpool_impl_t*>(_impl);
 
-	for (;;)
+	void* index;
+	if (!impl->_free_indices.pop(&index))
 	{
-		ga_intpool_pointer_t free_list = impl->_free_list;
-
-		if (free_list._part._index != k_ga_intpool_invalid_index)
-		{
-			index = free_list._part._index;
-			ga_intpool_pointer_t next = impl->_nodes[index]._next;
-
-			ga_intpool_pointer_t link;
-			link._part._index = next._part._index;
-			link._part._count = free_list._part._count + 1;
-			if (impl->_free_list._atomic.compare_exchange_strong(free_list._entire, link._entire))
-			{
-				break;
-			}
-		}
+		return -1;
 	}
-
-	return index;
+	return (int)reinterpret_cast<uintptr_t>(index);
 }
 
 void ga_intpool::free(int index)
 {
 	ga_intpool_impl_t* impl = static_cast<ga_intpool_impl_t*>(_impl);
+	assert(index >= 0 && index < impl->_index_count);
 
-	ga_intpool_node_t* node = impl->_nodes + index;
-	for (;;)
+	/*
+	** The queue has room for every index, but a pop that has claimed the slot
+	** we need and not yet released it makes it look full for a moment.
+	*/
+	while (!impl->_free_indices.push(reinterpret_cast<void*>((uintptr_t)index)))
 	{
-		ga_intpool_pointer_t free_list = impl->_free_list;
-		node->_next._part._index = free_list._part._index;
-
-		ga_intpool_pointer_t link;
-		link._part._index = index;
-		link._part._count = free_list._part._count + 1;
-		if (impl->_free_list._atomic.compare_exchange_strong(free_list._entire, link._entire))
-		{
-			break;
-		}
+		std::this_thread::yield();
 	}
 }
 
@@ -11,6 +11,8 @@
 
 /*
 ** A thread-safe and lock-free pool of integers.
+** The free indices are kept in a ga_queue, so they're handed out oldest
+** freed first.
 */
 class ga_intpool
 {
@@ -18,11 +20,15 @@ public:
 	ga_intpool(int index_count);
 	~ga_intpool();
 
+	/* Returns -1 if every index is in use. */
 	int alloc();
 	void free(int index);
 
 	int get_index_count() const;
 
 private:
+	ga_intpool(const ga_intpool&) = delete;
+	ga_intpool& operator=(const ga_intpool&) = delete;
+
 	void* _impl;
 };
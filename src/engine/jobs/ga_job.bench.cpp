@@ -0,0 +1,391 @@
+/**
+* Microbenchmarks for the job system and the pieces it's built from.
+* Measures empty job throughput, fan-out/fan-in latency, nested waits,
+* parallel reduce and scan, ga_queue and ga_intpool under contention, and
+* fiber switch cost. Results
+* are printed, and written as JSON so runs can be compared.
+*
+* Given a schedule file, the job benchmarks run in deterministic mode,
+* replaying the schedule if the file exists and recording it if not, so two
+* builds can be compared without scheduler noise.
+*
+* Usage: ga_job_bench [output json] [scale] [schedule]
+**/
+
+#include "ga_fiber.h"
+#include "ga_intpool.h"
+#include "ga_job.h"
+#include "ga_queue.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct bench_result_t
+{
+	std::string _name;
+	int _param;
+	uint64_t _ops;
+	double _seconds;
+};
+
+static std::vector<bench_result_t> g_results;
+static double g_scale = 1.0;
+static int g_worker_count = 0;
+static uint32_t g_schedule_hash = 0;
+
+static double seconds_since(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::duration<double>>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static uint64_t scaled(uint64_t count)
+{
+	uint64_t result = uint64_t(count * g_scale);
+	return result > 0 ? result : 1;
+}
+
+static void report(const char* name, int param, uint64_t ops, double seconds)
+{
+	bench_result_t result;
+	result._name = name;
+	result._param = param;
+	result._ops = ops;
+	result._seconds = seconds;
+	g_results.push_back(result);
+
+	printf("%-18s %6d %10llu ops %12.1f ns/op\n", name, param, (unsigned long long)ops, seconds * 1e9 / ops);
+}
+
+static void empty_job(void* data)
+{
+}
+
+// Throughput of jobs that do nothing, queued in batches from the main thread.
+static void bench_empty_jobs()
+{
+	const int k_batch_size = 256;
+	std::vector<ga_job_decl_t> decls(k_batch_size);
+	for (auto& decl : decls)
+	{
+		decl._entry = empty_job;
+	}
+
+	uint64_t batches = scaled(2000);
+	auto start = std::chrono::high_resolution_clock::now();
+	for (uint64_t i = 0; i < batches; ++i)
+	{
+		ga_job_counter_t counter;
+		ga_job::run(decls.data(), k_batch_size, &counter);
+		ga_job::wait(&counter);
+	}
+	report("empty_jobs", k_batch_size, batches * k_batch_size, seconds_since(start));
+}
+
+// Time from queueing n jobs to all of them having finished.
+static void bench_fan_out_in()
+{
+	for (int n = 1; n <= 10000; n *= 10)
+	{
+		std::vector<ga_job_decl_t> decls(n);
+		for (auto& decl : decls)
+		{
+			decl._entry = empty_job;
+		}
+
+		uint64_t rounds = scaled(200000 / n + 10);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint64_t i = 0; i < rounds; ++i)
+		{
+			ga_job_counter_t counter;
+			ga_job::run(decls.data(), n, &counter);
+			ga_job::wait(&counter);
+		}
+		report("fan_out_in", n, rounds, seconds_since(start));
+	}
+}
+
+// A binary tree of jobs where every inner job waits on its two children.
+static void nested_job(void* data)
+{
+	int depth = int(reinterpret_cast<intptr_t>(data));
+	if (depth == 0)
+	{
+		return;
+	}
+
+	ga_job_decl_t children[2];
+	for (auto& child : children)
+	{
+		child._entry = nested_job;
+		child._data = reinterpret_cast<void*>(intptr_t(depth - 1));
+		child._stack = k_job_stack_small;
+	}
+
+	ga_job_counter_t counter;
+	ga_job::run(children, 2, &counter);
+	ga_job::wait(&counter);
+}
+
+static void bench_nested_waits()
+{
+	for (int depth = 2; depth <= 10; depth += 4)
+	{
+		ga_job_decl_t root;
+		root._entry = nested_job;
+		root._data = reinterpret_cast<void*>(intptr_t(depth));
+		root._stack = k_job_stack_small;
+
+		uint64_t job_count = (uint64_t(2) << depth) - 1;
+		uint64_t rounds = scaled(200000 / job_count + 10);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint64_t i = 0; i < rounds; ++i)
+		{
+			ga_job_counter_t counter;
+			ga_job::run(&root, 1, &counter);
+			ga_job::wait(&counter);
+		}
+		report("nested_waits", depth, rounds * job_count, seconds_since(start));
+	}
+}
+
+// Summing and prefix summing n floats, as a per-substep reduction would.
+static void bench_reduce_scan()
+{
+	for (int n = 10000; n <= 100000; n *= 10)
+	{
+		std::vector<float> values(n, 1.0f);
+		std::vector<float> offsets(n);
+
+		uint64_t rounds = scaled(20000000 / n + 10);
+		volatile float sink = 0.0f;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint64_t i = 0; i < rounds; ++i)
+		{
+			sink = ga_job::parallel_reduce(0, n, 0, 0.0f,
+				[&values](int i, float& sum) { sum += values[i]; },
+				[](float a, float b) { return a + b; });
+		}
+		report("parallel_reduce", n, rounds, seconds_since(start));
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint64_t i = 0; i < rounds; ++i)
+		{
+			ga_job::parallel_exclusive_scan(values.data(), offsets.data(), n, 0, 0.0f,
+				[](float a, float b) { return a + b; });
+		}
+		report("parallel_scan", n, rounds, seconds_since(start));
+	}
+}
+
+// Items through a ga_queue with as many producers as consumers.
+static void bench_queue()
+{
+	for (int threads = 1; threads <= 64; threads *= 4)
+	{
+		ga_queue queue(1024);
+		uint64_t per_producer = scaled(1 << 20) / threads + 1;
+		std::atomic<uint64_t> consumed(0);
+		uint64_t total = per_producer * threads;
+
+		std::vector<std::thread> workers;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&queue, per_producer]()
+			{
+				for (uint64_t i = 0; i < per_producer; ++i)
+				{
+					while (!queue.push(reinterpret_cast<void*>(uintptr_t(i + 1))))
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+			workers.emplace_back([&queue, &consumed, total]()
+			{
+				void* data;
+				while (consumed.load(std::memory_order_relaxed) < total)
+				{
+					if (queue.pop(&data))
+					{
+						consumed.fetch_add(1, std::memory_order_relaxed);
+					}
+					else
+					{
+						std::this_thread::yield();
+					}
+				}
+			});
+		}
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+		report("queue_push_pop", threads, total, seconds_since(start));
+	}
+}
+
+// Alloc and free pairs on a shared ga_intpool.
+static void bench_intpool()
+{
+	for (int threads = 1; threads <= 64; threads *= 4)
+	{
+		ga_intpool pool(1024);
+		uint64_t per_thread = scaled(1 << 20) / threads + 1;
+
+		std::vector<std::thread> workers;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&pool, per_thread]()
+			{
+				for (uint64_t i = 0; i < per_thread; ++i)
+				{
+					int index;
+					while ((index = pool.alloc()) < 0)
+					{
+						std::this_thread::yield();
+					}
+					pool.free(index);
+				}
+			});
+		}
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+		report("intpool_alloc_free", threads, per_thread * threads, seconds_since(start));
+	}
+}
+
+struct ping_pong_t
+{
+	ga_fiber* _thread_fiber;
+	volatile uint64_t _count;
+};
+
+static void ping_pong_worker(void* data)
+{
+	ping_pong_t* state = static_cast<ping_pong_t*>(data);
+	for (;;)
+	{
+		state->_count++;
+		ga_fiber::switch_to(*state->_thread_fiber);
+	}
+}
+
+// Fiber switches, on a thread of its own since the main thread is already a job system fiber.
+static void bench_fiber_switch()
+{
+	std::thread thread([]()
+	{
+		ping_pong_t state;
+		state._count = 0;
+
+		ga_fiber thread_fiber = ga_fiber::convert_thread(&state);
+		ga_fiber worker(ping_pong_worker, &state, 64 * 1024);
+		state._thread_fiber = &thread_fiber;
+
+		uint64_t round_trips = scaled(2000000);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint64_t i = 0; i < round_trips; ++i)
+		{
+			ga_fiber::switch_to(worker);
+		}
+		report("fiber_switch", 0, round_trips * 2, seconds_since(start));
+	});
+	thread.join();
+}
+
+static bool write_json(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		return false;
+	}
+
+	fprintf(file, "{\n\t\"worker_count\": %d,\n\t\"scale\": %g,\n\t\"schedule_hash\": %u,\n\t\"results\": [\n",
+		g_worker_count, g_scale, g_schedule_hash);
+	for (size_t i = 0; i < g_results.size(); ++i)
+	{
+		const bench_result_t& result = g_results[i];
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"param\": %d, \"ops\": %llu, \"seconds\": %.9f, \"ns_per_op\": %.3f }%s\n",
+			result._name.c_str(), result._param, (unsigned long long)result._ops, result._seconds,
+			result._seconds * 1e9 / result._ops, i + 1 < g_results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+
+	return fclose(file) == 0;
+}
+
+int main(int argc, const char** argv)
+{
+	const char* json_path = argc > 1 ? argv[1] : "ga_job_bench.json";
+	g_scale = argc > 2 ? atof(argv[2]) : 1.0;
+	const char* schedule_path = argc > 3 ? argv[3] : nullptr;
+
+	// Room for the widest fan-out without running jobs inline, and for every inner nested job to wait.
+	ga_job_config_t config;
+	config._queue_size = 16 * 1024;
+	config._fiber_counts[k_job_stack_small] = 4096;
+
+	bool replaying = false;
+	if (schedule_path)
+	{
+		FILE* schedule = fopen(schedule_path, "rb");
+		replaying = schedule != nullptr;
+		if (schedule)
+		{
+			fclose(schedule);
+		}
+
+		config._deterministic = true;
+		config._worker_count = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1;
+		config._replay_path = replaying ? schedule_path : nullptr;
+	}
+
+	ga_cpu_set worker_cpus = ga_cpu_set::all();
+	worker_cpus.clear(0);
+	ga_job::startup(worker_cpus, config);
+
+	g_worker_count = ga_job::get_worker_count();
+	printf("%d workers%s\n", g_worker_count, !schedule_path ? "" : replaying ? ", replaying schedule" : ", recording schedule");
+	bench_empty_jobs();
+	bench_fan_out_in();
+	bench_nested_waits();
+	bench_reduce_scan();
+
+	if (schedule_path)
+	{
+		g_schedule_hash = ga_job::get_schedule_hash();
+		printf("schedule hash %08x\n", g_schedule_hash);
+		if (replaying && ga_job::has_replay_diverged())
+		{
+			printf("Replay diverged from %s.\n", schedule_path);
+		}
+		if (!replaying && !ga_job::write_schedule(schedule_path))
+		{
+			printf("Couldn't write %s.\n", schedule_path);
+		}
+	}
+
+	ga_job::shutdown();
+
+	bench_queue();
+	bench_intpool();
+	bench_fiber_switch();
+
+	if (!write_json(json_path))
+	{
+		printf("Couldn't write %s.\n", json_path);
+		return 1;
+	}
+	return 0;
+}
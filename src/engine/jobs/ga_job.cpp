@@ -10,11 +10,21 @@
 #include "ga_job.h"
 
 #include "ga_condvar.h"
+#include "ga_deque.h"
 #include "ga_fiber.h"
-#include "ga_intpool.h"
+#include "ga_job_trace.h"
 #include "ga_queue.h"
+#include "ga_semaphore.h"
+
+#include "framework/ga_compiler_defines.h"
+
+#if defined(GA_X64) || defined(GA_SSE2)
+#include <emmintrin.h>
+#endif
 
 #include <atomic>
+#include <cstdio>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -22,75 +32,453 @@ void* ga_job::_impl = 0;
 
 struct ga_job_instance_t
 {
-	ga_job_instance_t() {}
+	ga_job_instance_t() : _waiting_counter(0), _next_waiter(0), _pool(0), _parent_fiber(0) {}
 
-	ga_job_decl_t* _decl;
+	/* A copy, so a job may free its own decl while it runs. */
+	ga_job_decl_t _decl;
 
-	int32_t* _waiting_count;
+	/* Counter the job is waiting on, and the next job waiting on the same one. */
+	ga_job_counter_t* _waiting_counter;
+	void* _next_waiter;
 
-	int _pool_index;
+	struct ga_job_fiber_pool_t* _pool;
 
 	ga_fiber _fiber;
 	ga_fiber* _parent_fiber;
 };
 
+/*
+** Job instances of one stack class. An instance gets its fiber the first time
+** it's handed out, and goes back on the free queue, fiber and all, when its
+** job finishes.
+*/
+struct ga_job_fiber_pool_t
+{
+	ga_job_fiber_pool_t(int fiber_count, size_t stack_size) :
+		_free_instances(fiber_count),
+		_instances(new ga_job_instance_t[fiber_count]),
+		_fiber_count(fiber_count),
+		_stack_size(stack_size),
+		_created_count(0)
+	{
+	}
+
+	~ga_job_fiber_pool_t()
+	{
+		delete[] _instances;
+	}
+
+	/* Instances that have been used before. */
+	ga_queue _free_instances;
+
+	ga_job_instance_t* _instances;
+	int _fiber_count;
+	size_t _stack_size;
+
+	/* Instances handed out at least once; the rest have never been touched. */
+	std::atomic<int> _created_count;
+};
+
+/*
+** Marks continuations in a counter's waiters, which are otherwise job
+** instances. Both are pointer aligned, so the bit is free.
+*/
+static const uintptr_t k_continuation_tag = 2;
+
+/* Marks resumed job instances among deterministic mode's pending decls. */
+static const uintptr_t k_resume_tag = 1;
+
+/* Deterministic mode's pending work is ranked resumed first, then high, normal and low. */
+static const int k_pending_rank_count = 4;
+
+/* Priorities that workers queue and steal. Main thread jobs have their own queue. */
+static const int k_worker_priority_count = k_job_priority_main_thread;
+
+/* How often low priority jobs get looked at before normal ones. */
+static const uint32_t k_low_priority_interval = 8;
+
+/* Decls sorted and pushed at once by submit. */
+static const int k_submit_batch_size = 32;
+
+/* Identifies schedules written by ga_job::write_schedule. */
+static const uint32_t k_schedule_magic = 0x534a4147;
+static const uint32_t k_schedule_version = 1;
+
+/* Checks for work an idle worker makes, pausing between each, before it parks. */
+static const int k_default_idle_spin_count = 1000;
+
+/*
+** Per worker thread state.
+** Jobs run from inside a job go onto the worker's own deque for their
+** priority, which it pops newest first. Idle workers steal the oldest jobs
+** from random victims, trying ones on their own NUMA node first.
+*/
+struct ga_job_worker_t
+{
+	ga_job_worker_t(struct ga_job_system_impl_t* impl, int index, int cpu, int deque_size) :
+		_impl(impl),
+		_index(index),
+		_cpu(cpu),
+		_numa_node(ga_cpu_topology::get_numa_node(cpu)),
+		_near_victim_count(0),
+		_deque_size(deque_size),
+		_random(index * 2654435761u + 1),
+		_pick_count(0),
+		_sleeping(false),
+		_waiting_counter(0),
+		_assigned(0),
+		_inline_depth(0)
+	{
+		for (int i = 0; i < k_worker_priority_count; ++i)
+		{
+			_deques[i] = 0;
+		}
+	}
+
+	~ga_job_worker_t()
+	{
+		for (int i = 0; i < k_worker_priority_count; ++i)
+		{
+			delete _deques[i];
+		}
+	}
+
+	/* Called on the worker's own thread, after it's pinned. */
+	void create_deques()
+	{
+		for (int i = 0; i < k_worker_priority_count; ++i)
+		{
+			_deques[i] = new ga_deque(_deque_size);
+		}
+	}
+
+	struct ga_job_system_impl_t* _impl;
+	int _index;
+
+	/* Hardware thread the worker is pinned to, or -1 if it isn't. */
+	int _cpu;
+	int _numa_node;
+
+	/* Every other worker, those on the same node first. */
+	std::vector<ga_job_worker_t*> _victims;
+	int _near_victim_count;
+
+	/*
+	** Created and first written by the worker's own thread once it's pinned,
+	** so their pages land on the worker's own node.
+	*/
+	ga_deque* _deques[k_worker_priority_count];
+	int _deque_size;
+
+	uint32_t _random;
+	uint32_t _pick_count;
+
+	/* The thread's own fiber, which jobs switch back to. */
+	ga_fiber _thread_fiber;
+
+	/*
+	** A parked worker sleeps on its semaphore with _sleeping set. Whoever
+	** clears _sleeping owes it a signal. _waiting_counter is the counter it
+	** waits on outside a job, so the job that finishes it can wake the worker.
+	*/
+	ga_semaphore _semaphore;
+	std::atomic<bool> _sleeping;
+	std::atomic<const ga_job_counter_t*> _waiting_counter;
+
+	/*
+	** In deterministic mode, what the worker was picked to run next, and
+	** how many jobs it's running inline on its own fiber. Inline jobs that
+	** are waiting nest, so only the innermost may carry on.
+	*/
+	std::atomic<void*> _assigned;
+	int _inline_depth;
+	std::vector<ga_job_decl_t*> _inline_waits;
+};
+
 struct ga_job_system_impl_t
 {
-	ga_job_system_impl_t(int queue_size, int fiber_count) :
-		_main_thread(std::this_thread::get_id()),
-		_job_queue(queue_size),
-		_job_instance_pool(fiber_count),
-		_wait_queue(queue_size)
-	{}
+	ga_job_system_impl_t(const ga_job_config_t& config, int fiber_count) :
+		_main_queue(config._queue_size),
+		_ready_queue(fiber_count),
+		_main_ready_queue(fiber_count)
+	{
+		for (int i = 0; i < k_worker_priority_count; ++i)
+		{
+			_job_queues[i] = new ga_queue(config._queue_size);
+		}
+		for (int i = 0; i < k_job_stack_count; ++i)
+		{
+			_fiber_pools[i] = new ga_job_fiber_pool_t(config._fiber_counts[i], config._stack_sizes[i]);
+		}
+	}
+
+	~ga_job_system_impl_t()
+	{
+		for (int i = 0; i < k_worker_priority_count; ++i)
+		{
+			delete _job_queues[i];
+		}
+		for (int i = 0; i < k_job_stack_count; ++i)
+		{
+			delete _fiber_pools[i];
+		}
+	}
+
+	/* Jobs run from outside a worker, or that didn't fit on a worker's deque. */
+	ga_queue* _job_queues[k_worker_priority_count];
 
-	std::thread::id _main_thread;
+	/* Jobs that may only run on the main thread. */
+	ga_queue _main_queue;
 
-	ga_queue _job_queue;
+	/* Worker threads, and the main thread which works while it waits. */
+	std::vector<ga_job_worker_t*> _workers;
+	ga_job_worker_t* _main_worker;
 
-	ga_intpool _job_instance_pool;
-	ga_job_instance_t* _job_instance_data;
+	ga_job_fiber_pool_t* _fiber_pools[k_job_stack_count];
 
-	ga_queue _wait_queue;
+	/* Jobs that waited, and whose counters have since reached zero. */
+	ga_queue _ready_queue;
+	ga_queue _main_ready_queue;
 
 	std::vector<std::thread*> _worker_threads;
 
-	ga_condvar _work_added;
+	/* Worker threads that have created their deques, out of how many there are. */
+	std::atomic<int> _started_count;
+	int _worker_thread_count;
+
+	/* Threads other than workers wait on counters here. */
 	ga_condvar _work_exhausted;
 
-	bool _terminate;
+	std::atomic<int> _idle_spin_count;
+	std::atomic<int> _wake_cursor;
+
+	std::atomic<bool> _terminate;
+
+	/*
+	** Deterministic mode. Submitted decls and resumed instances wait in
+	** _pending, one list per rank, until picked. While a job runs, _running
+	** is set and nothing else is picked. Each pick is recorded as a rank, an
+	** index into that rank's list, and a worker index.
+	*/
+	bool _deterministic;
+	std::mutex _deterministic_mutex;
+	std::vector<void*> _pending[k_pending_rank_count];
+	bool _running;
+	uint32_t _seed;
+	uint32_t _random;
+	std::vector<uint32_t> _schedule;
+	uint32_t _schedule_hash;
+	std::vector<uint32_t> _replay;
+	size_t _replay_cursor;
+	bool _replay_diverged;
 };
 
+/*
+** The worker owning the current thread, if any.
+** A job's fiber can resume on another thread after a wait, so only read this
+** through a call the compiler can't inline past a fiber switch.
+*/
+static thread_local ga_job_worker_t* t_worker = 0;
+
+GA_NOINLINE static ga_job_worker_t* _ga_job_get_worker()
+{
+	return t_worker;
+}
+
+/*
+** The job running on the current thread, or null outside of a job.
+*/
+static thread_local ga_job_instance_t* t_current_job = 0;
+
+GA_NOINLINE static ga_job_instance_t* _ga_job_get_current_job()
+{
+	return t_current_job;
+}
+
+GA_NOINLINE static void _ga_job_set_current_job(ga_job_instance_t* job)
+{
+	t_current_job = job;
+}
+
 static int _ga_job_instance_thread_worker(void* data);
-static bool _ga_job_schedule(ga_job_system_impl_t* impl, ga_fiber* parent_fiber);
+static bool _ga_job_schedule(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_fiber* parent_fiber);
+static bool _ga_job_pick(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_job_decl_t** decl);
+static bool _ga_job_steal(ga_job_worker_t* worker, int priority, ga_job_decl_t** decl);
+static ga_job_instance_t* _ga_job_alloc_instance(ga_job_system_impl_t* impl, ga_job_stack_t stack);
+static void _ga_job_free_instance(ga_job_instance_t* job);
 static void _ga_job_run(ga_job_system_impl_t* impl, ga_fiber* parent_fiber, ga_job_instance_t* job);
+static void _ga_job_make_ready(ga_job_system_impl_t* impl, ga_job_instance_t* job);
+static void _ga_job_run_inline(ga_job_system_impl_t* impl, ga_job_decl_t* decl);
+static int _ga_job_push(ga_job_system_impl_t* impl, ga_job_worker_t* worker, int priority, void** decls, int count);
+static void _ga_job_push_main(ga_job_system_impl_t* impl, ga_job_worker_t* worker, void** decls, int count);
+static void _ga_job_wake(ga_job_system_impl_t* impl, int job_count);
+static bool _ga_job_wake_worker(ga_job_worker_t* worker);
+static bool _ga_job_has_work(ga_job_system_impl_t* impl, ga_job_worker_t* worker, bool full_scan);
+static void _ga_job_idle(ga_job_system_impl_t* impl, ga_job_worker_t* worker, const ga_job_counter_t* counter);
+static void _ga_job_pause();
+static bool _ga_job_add_waiter(ga_job_counter_t* counter, void* waiter, void** next);
+static void _ga_job_decrement(ga_job_system_impl_t* impl, ga_job_counter_t* counter);
 static void _ga_job_fiber_worker(void* data);
+static void _ga_job_parallel_for(void* data);
+static void _ga_job_queue_deterministic(ga_job_system_impl_t* impl, ga_job_decl_t* decls, int decl_count);
+static void _ga_job_queue_deterministic(ga_job_system_impl_t* impl, void* pending);
+static void _ga_job_pick_deterministic(ga_job_system_impl_t* impl);
+static bool _ga_job_run_deterministic(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_fiber* parent_fiber);
+static void _ga_job_run_assigned(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_fiber* parent_fiber, void* pending);
+static void _ga_job_wait_inline_deterministic(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_job_counter_t* counter);
+static void _ga_job_resume_inline(void* data);
+static bool _ga_job_read_schedule(ga_job_system_impl_t* impl, const char* path, uint32_t* seed, int* worker_count);
+
+/*
+** A piece of a parallel_for range.
+*/
+struct ga_job_range_t
+{
+	const ga_job_callable* _body;
+	int _begin;
+	int _end;
+	int _grain;
+};
+
+ga_job_config_t::ga_job_config_t() :
+	_queue_size(256),
+	_deterministic(false),
+	_seed(1),
+	_worker_count(4),
+	_replay_path(0)
+{
+	/* Plenty of small stacks for jobs that mostly wait, few large ones. */
+	_fiber_counts[k_job_stack_small] = 1024;
+	_fiber_counts[k_job_stack_medium] = 256;
+	_fiber_counts[k_job_stack_large] = 16;
+
+	_stack_sizes[k_job_stack_small] = 16 * 1024;
+	_stack_sizes[k_job_stack_medium] = 64 * 1024;
+	_stack_sizes[k_job_stack_large] = 512 * 1024;
+}
 
 void ga_job::startup(
 	uint32_t hardware_thread_mask,
 	int queue_size,
 	int fiber_count)
 {
-	ga_job_system_impl_t* impl = new ga_job_system_impl_t(queue_size, fiber_count);
+	startup(ga_cpu_set::from_mask(hardware_thread_mask), queue_size, fiber_count);
+}
+
+void ga_job::startup(
+	const ga_cpu_set& cpus,
+	int queue_size,
+	int fiber_count)
+{
+	ga_job_config_t config;
+	config._queue_size = queue_size;
+	config._fiber_counts[k_job_stack_medium] = fiber_count;
+	startup(cpus, config);
+}
+
+void ga_job::startup(
+	const ga_cpu_set& cpus,
+	const ga_job_config_t& config)
+{
+	/* Every fiber can be waiting at once, so the ready queues must hold them all. */
+	int fiber_count = 0;
+	for (int i = 0; i < k_job_stack_count; ++i)
+	{
+		fiber_count += config._fiber_counts[i];
+	}
+
+	int queue_size = config._queue_size;
+	ga_job_system_impl_t* impl = new ga_job_system_impl_t(config, fiber_count);
 
 	impl->_terminate = false;
+	impl->_idle_spin_count = k_default_idle_spin_count;
+	impl->_wake_cursor = 0;
+
+	/* A replayed schedule only holds if it runs with the seed and workers it was recorded with. */
+	uint32_t seed = config._seed;
+	int worker_count = config._worker_count;
+	impl->_deterministic = config._deterministic;
+	impl->_running = false;
+	impl->_schedule_hash = 2166136261u;
+	impl->_replay_cursor = 0;
+	impl->_replay_diverged = false;
+	if (impl->_deterministic && config._replay_path && !_ga_job_read_schedule(impl, config._replay_path, &seed, &worker_count))
+	{
+		impl->_replay_diverged = true;
+	}
+	impl->_seed = seed;
+	impl->_random = seed * 2654435761u | 1;
+
+	/*
+	** The main thread gets a worker too, so it can run jobs while it waits.
+	** Create every worker before starting any, so thieves see the full list.
+	*/
+	impl->_main_worker = new ga_job_worker_t(impl, 0, -1, queue_size);
+	impl->_main_worker->create_deques();
+	impl->_main_worker->_numa_node = ga_cpu_topology::get_numa_node(ga_cpu_topology::get_current_cpu());
+	impl->_main_worker->_thread_fiber = ga_fiber::convert_thread(0);
+#if defined(GA_JOB_TRACE)
+	ga_job_trace::set_thread_name("main");
+#endif
+	impl->_workers.push_back(impl->_main_worker);
+	t_worker = impl->_main_worker;
+
+	if (impl->_deterministic)
+	{
+		for (int i = 0; i < worker_count; ++i)
+		{
+			impl->_workers.push_back(new ga_job_worker_t(impl, (int)impl->_workers.size(), -1, queue_size));
+		}
+	}
+	else
+	{
+		/* Pinning outside the process's affinity would fail, and oversubscribe the CPUs it has. */
+		ga_cpu_set allowed = ga_cpu_topology::get_allowed_cpus();
+		int cpu_count = ga_cpu_topology::get_cpu_count();
+		for (int cpu = 0; cpu < cpus.get_size() && cpu < cpu_count; ++cpu)
+		{
+			if (cpus.is_set(cpu) && allowed.is_set(cpu))
+			{
+				impl->_workers.push_back(new ga_job_worker_t(impl, (int)impl->_workers.size(), cpu, queue_size));
+			}
+		}
+	}
 
-	impl->_job_instance_data = new ga_job_instance_t[fiber_count];
-	for (int i = 0; i < fiber_count; ++i)
+	for (auto& w : impl->_workers)
 	{
-		ga_job_instance_t* instance = &impl->_job_instance_data[i];
-		instance->_fiber = ga_fiber(_ga_job_fiber_worker, instance, 64 * 1024);
-		instance->_pool_index = i;
+		for (auto& victim : impl->_workers)
+		{
+			if (victim != w && victim->_numa_node == w->_numa_node)
+			{
+				w->_victims.push_back(victim);
+			}
+		}
+		w->_near_victim_count = (int)w->_victims.size();
+		for (auto& victim : impl->_workers)
+		{
+			if (victim != w && victim->_numa_node != w->_numa_node)
+			{
+				w->_victims.push_back(victim);
+			}
+		}
 	}
 
-	int hardware_thread_count = std::thread::hardware_concurrency();
-	for (int i = 0; i < hardware_thread_count; ++i)
+	impl->_started_count = 0;
+	impl->_worker_thread_count = (int)impl->_workers.size() - 1;
+	for (auto& w : impl->_workers)
 	{
-		if ((hardware_thread_mask & (1 << i)) != 0)
+		if (w != impl->_main_worker)
 		{
-			impl->_worker_threads.push_back(new std::thread(_ga_job_instance_thread_worker, impl));
+			impl->_worker_threads.push_back(new std::thread(_ga_job_instance_thread_worker, w));
 		}
 	}
 
+	/* Workers create their own deques, and nothing may steal until they all exist. */
+	while (impl->_started_count.load(std::memory_order_acquire) < impl->_worker_thread_count)
+	{
+		std::this_thread::yield();
+	}
+
 	_impl = impl;
 }
 
@@ -99,135 +487,1254 @@ void ga_job::shutdown()
 	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
 
 	impl->_terminate = true;
-	impl->_work_added.wake_all();
+	for (auto& w : impl->_workers)
+	{
+		if (w != impl->_main_worker)
+		{
+			w->_semaphore.signal();
+		}
+	}
 	for (auto& t : impl->_worker_threads)
 	{
 		t->join();
 		delete t;
 	}
 
-	delete[] impl->_job_instance_data;
+	t_worker = 0;
+	for (auto& w : impl->_workers)
+	{
+		delete w;
+	}
+
+	delete impl;
+	_impl = 0;
 }
 
-void ga_job::run(ga_job_decl_t* decls, int decl_count, int32_t* counter)
+void ga_job::run(ga_job_decl_t* decls, int decl_count, ga_job_counter_t* counter)
 {
-	*counter = decl_count;
+	counter->reset(decl_count);
 
-	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
 	for (int i = 0; i < decl_count; ++i)
 	{
-		decls[i]._pending_count = counter;
-		impl->_job_queue.push(decls + i);
+		decls[i]._counter = counter;
+	}
+
+	submit(decls, decl_count);
+}
+
+void ga_job::submit(ga_job_decl_t* decls, int decl_count)
+{
+	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
+	ga_job_worker_t* worker = _ga_job_get_worker();
+
+	if (impl->_deterministic)
+	{
+		_ga_job_queue_deterministic(impl, decls, decl_count);
+		return;
+	}
+
+	/* Sort the decls by priority a batch at a time, and queue each group with one push. */
+	void* batches[k_job_priority_count][k_submit_batch_size];
+	int queued = 0;
+	bool main_thread_work = false;
+	for (int first = 0; first < decl_count; first += k_submit_batch_size)
+	{
+		int batch_counts[k_job_priority_count] = {};
+		int last = first + k_submit_batch_size < decl_count ? first + k_submit_batch_size : decl_count;
+		for (int i = first; i < last; ++i)
+		{
+			int priority = decls[i]._priority;
+			batches[priority][batch_counts[priority]++] = decls + i;
+		}
+
+		for (int priority = 0; priority < k_worker_priority_count; ++priority)
+		{
+			queued += _ga_job_push(impl, worker, priority, batches[priority], batch_counts[priority]);
+		}
+
+		if (batch_counts[k_job_priority_main_thread] > 0)
+		{
+			_ga_job_push_main(impl, worker, batches[k_job_priority_main_thread], batch_counts[k_job_priority_main_thread]);
+			main_thread_work = true;
+		}
 	}
 
-	impl->_work_added.wake_all();
+	_ga_job_wake(impl, queued);
+	if (main_thread_work)
+	{
+		_ga_job_wake_worker(impl->_main_worker);
+	}
 }
 
-void ga_job::wait(int32_t* counter)
+void ga_job::wait(ga_job_counter_t* counter)
 {
-	if (*counter > 0)
+	if (!counter->is_done())
 	{
 		/*
-		** If we're not the main thread, assume we're waiting from within a job.
-		** In this case, push the current job onto the wait list, and reschedule.
+		** If we're waiting from within a job, switch back to the scheduler,
+		** which adds the job to the counter's waiters. Adding it here would let
+		** another thread resume the fiber before it has finished switching out.
 		*/
 		ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
-		if (std::this_thread::get_id() != impl->_main_thread)
+		ga_job_instance_t* job = _ga_job_get_current_job();
+		if (job)
 		{
-			ga_job_instance_t* job = static_cast<ga_job_instance_t*>(ga_fiber::get_data());
-			job->_waiting_count = counter;
-			impl->_wait_queue.push(job);
-
+			job->_waiting_counter = counter;
 			ga_fiber::switch_to(*job->_parent_fiber);
+			return;
 		}
+
 		/*
-		** Otherwise, in the main thread, block until jobs are complete.
+		** Otherwise, on the main thread, run jobs until the counter drains,
+		** idling like any other worker when there are none.
 		*/
-		else
+		ga_job_worker_t* worker = _ga_job_get_worker();
+		if (worker && impl->_deterministic && worker->_inline_depth > 0)
 		{
-			while (*counter > 0)
+			_ga_job_wait_inline_deterministic(impl, worker, counter);
+			return;
+		}
+		if (worker)
+		{
+			while (!counter->is_done())
 			{
-				impl->_work_exhausted.wait();
+				if (!_ga_job_schedule(impl, worker, &worker->_thread_fiber))
+				{
+					GA_JOB_TRACE_EVENT(k_job_trace_idle_begin, 0, 0);
+					_ga_job_idle(impl, worker, counter);
+					GA_JOB_TRACE_EVENT(k_job_trace_idle_end, 0, 0);
+				}
 			}
+			return;
+		}
+
+		/*
+		** Any other thread just blocks until jobs are complete. The timeout
+		** only matters if a wake up is missed.
+		*/
+		while (!counter->is_done())
+		{
+			impl->_work_exhausted.wait_for(1);
 		}
 	}
 }
 
-static int _ga_job_instance_thread_worker(void* data)
+void ga_job::submit_when_done(ga_job_counter_t* counter, ga_job_continuation_t* continuation)
+{
+	void* waiter = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(continuation) | k_continuation_tag);
+	if (!_ga_job_add_waiter(counter, waiter, &continuation->_next))
+	{
+		submit(continuation->_decl, 1);
+	}
+}
+
+void ga_job::signal(ga_job_counter_t* counter)
 {
-	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(data);
+	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
+	_ga_job_decrement(impl, counter);
+}
 
-	ga_fiber parent_fiber = ga_fiber::convert_thread(0);
+void ga_job::set_idle_spin_count(int count)
+{
+	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
+	impl->_idle_spin_count.store(count > 0 ? count : 0, std::memory_order_relaxed);
+}
 
-	while (!impl->_terminate)
+int ga_job::get_worker_count()
+{
+	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
+	return (int)impl->_workers.size();
+}
+
+int ga_job::get_worker_index()
+{
+	ga_job_worker_t* worker = _ga_job_get_worker();
+	return worker ? worker->_index : -1;
+}
+
+size_t ga_job::get_stack_high_water(ga_job_stack_t stack)
+{
+	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
+	ga_job_fiber_pool_t* pool = impl->_fiber_pools[stack];
+
+	size_t high_water = 0;
+	int created_count = pool->_created_count.load(std::memory_order_acquire);
+	for (int i = 0; i < created_count; ++i)
 	{
-		if (!_ga_job_schedule(impl, &parent_fiber))
-		{
-			impl->_work_exhausted.wake_all();
-			impl->_work_added.wait_for(1000);
-		}
+		size_t used = pool->_instances[i]._fiber.get_stack_high_water();
+		high_water = used > high_water ? used : high_water;
 	}
-
-	return 0;
+	return high_water;
 }
 
-static bool _ga_job_schedule(ga_job_system_impl_t* impl, ga_fiber* parent_fiber)
+bool ga_job::write_schedule(const char* path)
 {
-	/* Check for waiting jobs that are ready to run. */
-	ga_job_instance_t* job;
-	int retry_wait_count = impl->_wait_queue.get_count();
-	while (retry_wait_count-- > 0 && impl->_wait_queue.pop((void**)&job))
+	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
+	if (!impl->_deterministic)
 	{
-		if (job->_waiting_count == 0 || job->_waiting_count[0] == 0)
-		{
-			_ga_job_run(impl, parent_fiber, job);
-			return true;
-		}
-		else
-		{
-			impl->_wait_queue.push(job);
-		}
+		return false;
 	}
 
-	/* Look for queued jobs. */
-	ga_job_decl_t* decl;
-	if (impl->_job_queue.pop((void**)&decl))
+	FILE* file = fopen(path, "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(impl->_deterministic_mutex);
+	uint32_t header[5] =
 	{
-		int ga_job_index = impl->_job_instance_pool.alloc();
+		k_schedule_magic,
+		k_schedule_version,
+		impl->_seed,
+		uint32_t(impl->_workers.size() - 1),
+		uint32_t(impl->_schedule.size() / 3),
+	};
+	bool written = fwrite(header, sizeof(header), 1, file) == 1;
+	if (written && !impl->_schedule.empty())
+	{
+		written = fwrite(impl->_schedule.data(), sizeof(uint32_t), impl->_schedule.size(), file) == impl->_schedule.size();
+	}
+	return fclose(file) == 0 && written;
+}
 
-		job = &impl->_job_instance_data[ga_job_index];
-		job->_decl = decl;
-		job->_pool_index = ga_job_index;
+uint32_t ga_job::get_schedule_hash()
+{
+	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
+	std::lock_guard<std::mutex> lock(impl->_deterministic_mutex);
+	return impl->_schedule_hash;
+}
 
-		_ga_job_run(impl, parent_fiber, job);
+bool ga_job::has_replay_diverged()
+{
+	ga_job_system_impl_t* impl = static_cast<ga_job_system_impl_t*>(_impl);
+	std::lock_guard<std::mutex> lock(impl->_deterministic_mutex);
+	return impl->_replay_diverged;
+}
 
-		return true;
+void ga_job::parallel_for_callable(int begin, int end, int grain, const ga_job_callable& body)
+{
+	if (grain <= 0)
+	{
+		/* A few pieces per worker leaves room to balance uneven work. */
+		int worker_count = get_worker_count();
+		int piece_count = 4 * (worker_count > 0 ? worker_count : 1);
+		grain = (end - begin + piece_count - 1) / piece_count;
+		grain = grain > 0 ? grain : 1;
+	}
+
+	ga_job_range_t range;
+	range._body = &body;
+	range._begin = begin;
+	range._end = end;
+	range._grain = grain;
+
+	/* The caller works on the range too, rather than just waiting. */
+	_ga_job_parallel_for(&range);
+}
+
+int ga_job::get_reduce_piece_size(int count, int grain)
+{
+	if (grain <= 0)
+	{
+		/* A few pieces per worker, as for parallel_for. */
+		int worker_count = get_worker_count();
+		int piece_count = 4 * (worker_count > 0 ? worker_count : 1);
+		grain = (count + piece_count - 1) / piece_count;
 	}
 
-	return impl->_wait_queue.get_count() != 0;
+	/* Partials live on the caller's stack, so there can only be so many pieces. */
+	int min_grain = (count + k_max_reduce_pieces - 1) / k_max_reduce_pieces;
+	grain = grain > min_grain ? grain : min_grain;
+	return grain > 0 ? grain : 1;
 }
 
-static void _ga_job_run(ga_job_system_impl_t* impl, ga_fiber* parent_fiber, ga_job_instance_t* job)
+static int _ga_job_instance_thread_worker(void* data)
 {
-	job->_parent_fiber = parent_fiber;
-	job->_waiting_count = 0;
+	ga_job_worker_t* worker = static_cast<ga_job_worker_t*>(data);
+	ga_job_system_impl_t* impl = worker->_impl;
 
-	ga_fiber::switch_to(job->_fiber);
+	/* Pin first, so the deques are allocated and first touched on the worker's node. */
+	if (worker->_cpu >= 0 && !ga_cpu_topology::pin_current_thread(worker->_cpu))
+	{
+		worker->_cpu = -1;
+	}
+	worker->create_deques();
 
-	if (job->_waiting_count == 0 || job->_waiting_count[0] == 0)
+	impl->_started_count.fetch_add(1, std::memory_order_release);
+	while (impl->_started_count.load(std::memory_order_acquire) < impl->_worker_thread_count)
 	{
-		impl->_job_instance_pool.free(job->_pool_index);
+		std::this_thread::yield();
+	}
+
+	t_worker = worker;
+
+#if defined(GA_JOB_TRACE)
+	char name[32];
+	snprintf(name, sizeof(name), "worker %d", worker->_index);
+	ga_job_trace::set_thread_name(name);
+#endif
+
+	worker->_thread_fiber = ga_fiber::convert_thread(0);
 
-		(*reinterpret_cast<std::atomic_int*>(job->_decl->_pending_count))--;
+	while (!impl->_terminate)
+	{
+		if (!_ga_job_schedule(impl, worker, &worker->_thread_fiber))
+		{
+			GA_JOB_TRACE_EVENT(k_job_trace_idle_begin, 0, 0);
+			_ga_job_idle(impl, worker, 0);
+			GA_JOB_TRACE_EVENT(k_job_trace_idle_end, 0, 0);
+		}
 	}
+
+	return 0;
 }
 
-static void _ga_job_fiber_worker(void* data)
+static bool _ga_job_schedule(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_fiber* parent_fiber)
 {
-	for (;;)
+	if (impl->_deterministic)
 	{
-		ga_job_instance_t* job = static_cast<ga_job_instance_t*>(ga_fiber::get_data());
-		job->_decl->_entry(job->_decl->_data);
-		ga_fiber::switch_to(*job->_parent_fiber);
+		return _ga_job_run_deterministic(impl, worker, parent_fiber);
+	}
+
+	/* Resume jobs whose counters have reached zero. */
+	ga_job_instance_t* job;
+	bool main_thread = worker == impl->_main_worker;
+	if ((main_thread && impl->_main_ready_queue.pop((void**)&job)) ||
+		impl->_ready_queue.pop((void**)&job))
+	{
+		_ga_job_run(impl, parent_fiber, job);
+		return true;
 	}
+
+	ga_job_decl_t* decl;
+	if ((main_thread && impl->_main_queue.pop((void**)&decl)) ||
+		_ga_job_pick(impl, worker, &decl))
+	{
+		job = _ga_job_alloc_instance(impl, decl->_stack);
+		if (!job)
+		{
+			/*
+			** Every fiber is taken, most likely by jobs that are waiting. Run
+			** this one on the thread's own fiber instead, so they can't end up
+			** waiting on jobs that have nowhere to run.
+			*/
+			_ga_job_run_inline(impl, decl);
+			return true;
+		}
+
+		job->_decl = *decl;
+
+		_ga_job_run(impl, parent_fiber, job);
+
+		return true;
+	}
+
+	return false;
+}
+
+/*
+** Finds the next queued job, going through the priorities in order. Within a
+** priority our own jobs come first, then shared ones, then other workers'.
+*/
+static bool _ga_job_pick(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_job_decl_t** decl)
+{
+	int order[k_worker_priority_count] = { k_job_priority_high, k_job_priority_normal, k_job_priority_low };
+	if (++worker->_pick_count % k_low_priority_interval == 0)
+	{
+		order[1] = k_job_priority_low;
+		order[2] = k_job_priority_normal;
+	}
+
+	for (int i = 0; i < k_worker_priority_count; ++i)
+	{
+		int priority = order[i];
+		if (worker->_deques[priority]->pop((void**)decl) ||
+			impl->_job_queues[priority]->pop((void**)decl) ||
+			_ga_job_steal(worker, priority, decl))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool _ga_job_steal(ga_job_worker_t* worker, int priority, ga_job_decl_t** decl)
+{
+	int victim_count = (int)worker->_victims.size();
+	if (victim_count == 0)
+	{
+		return false;
+	}
+
+	/*
+	** Visit every other worker once, starting from a random one. Workers on
+	** our own node go first, since their jobs' data is likely close by.
+	*/
+	worker->_random ^= worker->_random << 13;
+	worker->_random ^= worker->_random >> 17;
+	worker->_random ^= worker->_random << 5;
+
+	int near_count = worker->_near_victim_count;
+	int far_count = victim_count - near_count;
+	for (int i = 0; i < near_count; ++i)
+	{
+		ga_job_worker_t* victim = worker->_victims[(worker->_random + i) % near_count];
+		if (victim->_deques[priority]->steal((void**)decl))
+		{
+			GA_JOB_TRACE_EVENT(k_job_trace_steal, (*decl)->_name, victim);
+			return true;
+		}
+	}
+	for (int i = 0; i < far_count; ++i)
+	{
+		ga_job_worker_t* victim = worker->_victims[near_count + (worker->_random + i) % far_count];
+		if (victim->_deques[priority]->steal((void**)decl))
+		{
+			GA_JOB_TRACE_EVENT(k_job_trace_steal, (*decl)->_name, victim);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+** Takes an instance from the pool for the stack class, or a larger one if
+** that is used up. Returns null if every pool that would do is used up.
+*/
+static ga_job_instance_t* _ga_job_alloc_instance(ga_job_system_impl_t* impl, ga_job_stack_t stack)
+{
+	for (int i = stack; i < k_job_stack_count; ++i)
+	{
+		ga_job_fiber_pool_t* pool = impl->_fiber_pools[i];
+
+		/* Reuse a fiber if there is one, so its stack is already in memory. */
+		ga_job_instance_t* job = 0;
+		if (!pool->_free_instances.pop((void**)&job))
+		{
+			int index = pool->_created_count.load(std::memory_order_relaxed);
+			while (index < pool->_fiber_count)
+			{
+				if (pool->_created_count.compare_exchange_weak(index, index + 1, std::memory_order_acq_rel))
+				{
+					job = &pool->_instances[index];
+					job->_pool = pool;
+					break;
+				}
+			}
+		}
+
+		if (!job)
+		{
+			continue;
+		}
+
+		if (!job->_fiber.is_valid())
+		{
+			job->_fiber = ga_fiber(_ga_job_fiber_worker, job, pool->_stack_size);
+			if (!job->_fiber.is_valid())
+			{
+				/* Out of address space; leave it for a later try. */
+				_ga_job_free_instance(job);
+				return 0;
+			}
+		}
+
+		return job;
+	}
+
+	return 0;
+}
+
+static void _ga_job_free_instance(ga_job_instance_t* job)
+{
+	/* The queue holds every instance, but a push can still lose to a pop finishing on the same slot. */
+	while (!job->_pool->_free_instances.push(job))
+	{
+		std::this_thread::yield();
+	}
+}
+
+static void _ga_job_run(ga_job_system_impl_t* impl, ga_fiber* parent_fiber, ga_job_instance_t* job)
+{
+	if (job->_waiting_counter)
+	{
+		GA_JOB_TRACE_EVENT(k_job_trace_wait_end, job->_decl._name, job);
+	}
+
+	job->_parent_fiber = parent_fiber;
+	job->_waiting_counter = 0;
+
+	GA_JOB_TRACE_EVENT(k_job_trace_run_begin, job->_decl._name, job);
+	_ga_job_set_current_job(job);
+	ga_fiber::switch_to(job->_fiber);
+	_ga_job_set_current_job(0);
+	GA_JOB_TRACE_EVENT(k_job_trace_run_end, job->_decl._name, job);
+
+	/* The job either finished, or switched out to wait on a counter. */
+	if (job->_waiting_counter == 0)
+	{
+		/* Another thread may reuse the instance as soon as it's freed, so read the decl first. */
+		ga_job_counter_t* counter = job->_decl._counter;
+		_ga_job_free_instance(job);
+
+		_ga_job_decrement(impl, counter);
+	}
+	else
+	{
+		/* Recorded first, since once the job is a waiter another thread may resume it. */
+		GA_JOB_TRACE_EVENT(k_job_trace_wait_begin, job->_decl._name, job);
+		if (!_ga_job_add_waiter(job->_waiting_counter, job, &job->_next_waiter))
+		{
+			/* The counter reached zero while the job was switching out. */
+			_ga_job_make_ready(impl, job);
+		}
+	}
+}
+
+/*
+** Queues a waiting job to be resumed. Main thread jobs must resume there.
+*/
+static void _ga_job_make_ready(ga_job_system_impl_t* impl, ga_job_instance_t* job)
+{
+	if (impl->_deterministic)
+	{
+		_ga_job_queue_deterministic(impl, reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(job) | k_resume_tag));
+		return;
+	}
+
+	/*
+	** Ready queues have room for every fiber, so a push only fails while a
+	** pop is still releasing the slot it needs.
+	*/
+	ga_queue* queue = job->_decl._priority == k_job_priority_main_thread ? &impl->_main_ready_queue : &impl->_ready_queue;
+	while (!queue->push(job))
+	{
+		std::this_thread::yield();
+	}
+}
+
+/*
+** Queues decls of one priority: as many as fit on the worker's own deque,
+** then the shared queue. Whatever is left runs here rather than wait for
+** room. Returns how many were queued.
+*/
+static int _ga_job_push(ga_job_system_impl_t* impl, ga_job_worker_t* worker, int priority, void** decls, int count)
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	int queued = worker ? worker->_deques[priority]->push_batch(decls, count) : 0;
+	if (queued < count)
+	{
+		queued += impl->_job_queues[priority]->push_batch(decls + queued, count - queued);
+	}
+
+	for (int i = queued; i < count; ++i)
+	{
+		_ga_job_run_inline(impl, static_cast<ga_job_decl_t*>(decls[i]));
+	}
+
+	return queued;
+}
+
+/*
+** Queues main thread decls. If they don't fit, the main thread just runs
+** them, and anyone else waits for the main thread to make room.
+*/
+static void _ga_job_push_main(ga_job_system_impl_t* impl, ga_job_worker_t* worker, void** decls, int count)
+{
+	int queued = impl->_main_queue.push_batch(decls, count);
+	while (queued < count)
+	{
+		if (worker == impl->_main_worker)
+		{
+			_ga_job_run_inline(impl, static_cast<ga_job_decl_t*>(decls[queued++]));
+		}
+		else
+		{
+			_ga_job_wake_worker(impl->_main_worker);
+			std::this_thread::yield();
+			queued += impl->_main_queue.push_batch(decls + queued, count - queued);
+		}
+	}
+}
+
+/*
+** Wakes a parked worker for each new job, up to however many are parked.
+** Workers that are still spinning will find the jobs by themselves.
+*/
+static void _ga_job_wake(ga_job_system_impl_t* impl, int job_count)
+{
+	if (job_count <= 0)
+	{
+		return;
+	}
+
+	/* Pairs with the fence in _ga_job_idle: either we see the worker parked, or it sees the jobs. */
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	/* A worker wakes its own node first, so the jobs it queued are stolen without crossing nodes. */
+	ga_job_worker_t* worker = _ga_job_get_worker();
+	if (worker)
+	{
+		for (auto& victim : worker->_victims)
+		{
+			if (job_count == 0)
+			{
+				return;
+			}
+			if (_ga_job_wake_worker(victim))
+			{
+				--job_count;
+			}
+		}
+		return;
+	}
+
+	/* Start somewhere different each time so the same workers aren't always woken first. */
+	int worker_count = (int)impl->_workers.size();
+	int start = impl->_wake_cursor.load(std::memory_order_relaxed);
+	impl->_wake_cursor.store(start + 1, std::memory_order_relaxed);
+
+	for (int i = 0; i < worker_count && job_count > 0; ++i)
+	{
+		if (_ga_job_wake_worker(impl->_workers[(start + i) % worker_count]))
+		{
+			--job_count;
+		}
+	}
+}
+
+/*
+** Wakes a worker if it's parked. Returns whether it was.
+*/
+static bool _ga_job_wake_worker(ga_job_worker_t* worker)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (worker->_sleeping.load(std::memory_order_relaxed) && worker->_sleeping.exchange(false))
+	{
+		worker->_semaphore.signal();
+		return true;
+	}
+	return false;
+}
+
+/*
+** Whether there's anything a worker could run. Only a hint, since other
+** workers may take the jobs first. Without a full scan it looks at the
+** shared queues, the worker's own deques and one other worker's, so spinning
+** workers don't all keep reading every deque in the system.
+*/
+static bool _ga_job_has_work(ga_job_system_impl_t* impl, ga_job_worker_t* worker, bool full_scan)
+{
+	if (impl->_deterministic)
+	{
+		return worker->_assigned.load(std::memory_order_acquire) != 0;
+	}
+
+	if (impl->_ready_queue.get_count() > 0)
+	{
+		return true;
+	}
+	if (worker == impl->_main_worker && (impl->_main_ready_queue.get_count() > 0 || impl->_main_queue.get_count() > 0))
+	{
+		return true;
+	}
+
+	for (int priority = 0; priority < k_worker_priority_count; ++priority)
+	{
+		if (impl->_job_queues[priority]->get_count() > 0 || worker->_deques[priority]->get_count() > 0)
+		{
+			return true;
+		}
+	}
+
+	if (full_scan)
+	{
+		for (auto& w : impl->_workers)
+		{
+			for (int priority = 0; priority < k_worker_priority_count; ++priority)
+			{
+				if (w->_deques[priority]->get_count() > 0)
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	int victim_count = (int)worker->_victims.size();
+	if (victim_count == 0)
+	{
+		return false;
+	}
+
+	/* Mostly look at workers on our own node, and now and then at any of them. */
+	worker->_random ^= worker->_random << 13;
+	worker->_random ^= worker->_random >> 17;
+	worker->_random ^= worker->_random << 5;
+
+	int near_count = worker->_near_victim_count;
+	bool near = near_count > 0 && (worker->_random & 3) != 0;
+	ga_job_worker_t* victim = worker->_victims[(worker->_random >> 2) % (near ? near_count : victim_count)];
+	for (int priority = 0; priority < k_worker_priority_count; ++priority)
+	{
+		if (victim->_deques[priority]->get_count() > 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+** Called when a worker finds nothing to run. It spins for a while in case
+** work turns up soon, since parking and waking cost system calls, and then
+** parks until woken. Returns when there may be work, the counter is done, or
+** the system is shutting down.
+*/
+static void _ga_job_idle(ga_job_system_impl_t* impl, ga_job_worker_t* worker, const ga_job_counter_t* counter)
+{
+	int spin_count = impl->_idle_spin_count.load(std::memory_order_relaxed);
+	for (int i = 0; i < spin_count; ++i)
+	{
+		_ga_job_pause();
+		if (_ga_job_has_work(impl, worker, false) || (counter && counter->is_done()) || impl->_terminate)
+		{
+			return;
+		}
+	}
+
+	/* Announce we're parking, then look once more, so a wake can't slip in between. */
+	worker->_waiting_counter.store(counter, std::memory_order_relaxed);
+	worker->_sleeping.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (_ga_job_has_work(impl, worker, true) || (counter && counter->is_done()) || impl->_terminate)
+	{
+		if (worker->_sleeping.exchange(false))
+		{
+			worker->_waiting_counter.store(0, std::memory_order_relaxed);
+			return;
+		}
+
+		/* Someone is already waking us. Take their signal so it isn't left over. */
+	}
+
+	worker->_semaphore.wait();
+	worker->_waiting_counter.store(0, std::memory_order_relaxed);
+}
+
+static void _ga_job_pause()
+{
+#if defined(GA_X64) || defined(GA_SSE2)
+	_mm_pause();
+#elif defined(GA_ARM64)
+	__asm__ __volatile__("yield");
+#else
+	std::this_thread::yield();
+#endif
+}
+
+/*
+** Runs a job straight away on the calling fiber, for when it can't be queued
+** or given a fiber of its own.
+*/
+static void _ga_job_run_inline(ga_job_system_impl_t* impl, ga_job_decl_t* decl)
+{
+	ga_job_decl_t job = *decl;
+	GA_JOB_TRACE_EVENT(k_job_trace_run_begin, job._name, decl);
+	job._entry(job._data);
+	GA_JOB_TRACE_EVENT(k_job_trace_run_end, job._name, decl);
+	_ga_job_decrement(impl, job._counter);
+}
+
+/*
+** Pushes a job instance or tagged continuation onto a counter's waiters,
+** linking it through next. Fails if the counter is done.
+*/
+static bool _ga_job_add_waiter(ga_job_counter_t* counter, void* waiter, void** next)
+{
+	void* head = counter->_waiters.load(std::memory_order_acquire);
+	for (;;)
+	{
+		if (head == ga_job_counter_t::done_marker())
+		{
+			return false;
+		}
+
+		*next = head;
+		if (counter->_waiters.compare_exchange_weak(head, waiter, std::memory_order_acq_rel, std::memory_order_acquire))
+		{
+			return true;
+		}
+	}
+}
+
+/*
+** Counts down a finished job. The job that reaches zero marks the counter
+** done and hands every waiter to the ready queue.
+*/
+static void _ga_job_decrement(ga_job_system_impl_t* impl, ga_job_counter_t* counter)
+{
+	/* Jobs submitted without a counter have nothing to count down. */
+	if (!counter || counter->_value.fetch_sub(1, std::memory_order_acq_rel) != 1)
+	{
+		return;
+	}
+
+	void* head = counter->_waiters.exchange(ga_job_counter_t::done_marker(), std::memory_order_acq_rel);
+
+	/* A waiter can be resumed and wait again the moment it's queued, so step past it first. */
+	void* next = head;
+	int waiter_count = 0;
+	bool main_thread_waiter = false;
+	while (next)
+	{
+		if (reinterpret_cast<uintptr_t>(next) & k_continuation_tag)
+		{
+			ga_job_continuation_t* continuation = reinterpret_cast<ga_job_continuation_t*>(
+				reinterpret_cast<uintptr_t>(next) & ~k_continuation_tag);
+			next = continuation->_next;
+			ga_job::submit(continuation->_decl, 1);
+			continue;
+		}
+
+		ga_job_instance_t* waiter = static_cast<ga_job_instance_t*>(next);
+		next = waiter->_next_waiter;
+		if (waiter->_decl._priority == k_job_priority_main_thread)
+		{
+			main_thread_waiter = true;
+		}
+		else
+		{
+			++waiter_count;
+		}
+		_ga_job_make_ready(impl, waiter);
+	}
+
+	_ga_job_wake(impl, waiter_count);
+	if (main_thread_waiter)
+	{
+		_ga_job_wake_worker(impl->_main_worker);
+	}
+
+	/* Wake anyone waiting on the counter outside a job. */
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	for (auto& w : impl->_workers)
+	{
+		if (w->_waiting_counter.load(std::memory_order_relaxed) == counter)
+		{
+			_ga_job_wake_worker(w);
+		}
+	}
+	impl->_work_exhausted.wake_all();
+}
+
+static void _ga_job_fiber_worker(void* data)
+{
+	for (;;)
+	{
+		ga_job_instance_t* job = static_cast<ga_job_instance_t*>(ga_fiber::get_data());
+		job->_decl._entry(job->_decl._data);
+		ga_fiber::switch_to(*job->_parent_fiber);
+	}
+}
+
+static void _ga_job_parallel_for(void* data)
+{
+	const ga_job_range_t* range = static_cast<const ga_job_range_t*>(data);
+	int begin = range->_begin;
+	int end = range->_end;
+
+	/* Pieces share the caller's priority, stack and name, except that any worker may run them. */
+	ga_job_instance_t* job = _ga_job_get_current_job();
+	ga_job_priority_t priority = job ? job->_decl._priority : k_job_priority_normal;
+	priority = priority == k_job_priority_main_thread ? k_job_priority_high : priority;
+	ga_job_stack_t stack = job ? job->_decl._stack : k_job_stack_medium;
+	const char* name = job ? job->_decl._name : "parallel_for";
+
+	/*
+	** Hand the upper half to a new job until one grain is left, then run that
+	** here. Each new job splits its own half the same way. Halving an int
+	** range can't take more than 32 steps.
+	*/
+	const int k_max_splits = 32;
+	ga_job_range_t splits[k_max_splits];
+	ga_job_decl_t decls[k_max_splits];
+	int split_count = 0;
+
+	while (end - begin > range->_grain && split_count < k_max_splits)
+	{
+		int middle = begin + (end - begin) / 2;
+
+		ga_job_range_t& split = splits[split_count];
+		split._body = range->_body;
+		split._begin = middle;
+		split._end = end;
+		split._grain = range->_grain;
+
+		decls[split_count]._entry = _ga_job_parallel_for;
+		decls[split_count]._data = &split;
+		decls[split_count]._priority = priority;
+		decls[split_count]._stack = stack;
+		decls[split_count]._name = name;
+		++split_count;
+
+		end = middle;
+	}
+
+	ga_job_counter_t counter;
+	if (split_count > 0)
+	{
+		ga_job::run(decls, split_count, &counter);
+	}
+
+	(*range->_body)(begin, end);
+
+	ga_job::wait(&counter);
+}
+
+static ga_job_priority_t _ga_job_pending_priority(void* pending)
+{
+	if (reinterpret_cast<uintptr_t>(pending) & k_resume_tag)
+	{
+		return reinterpret_cast<ga_job_instance_t*>(reinterpret_cast<uintptr_t>(pending) & ~k_resume_tag)->_decl._priority;
+	}
+	return static_cast<ga_job_decl_t*>(pending)->_priority;
+}
+
+/*
+** Orders pending work the way the scheduler would: jobs being resumed come
+** first, then new jobs by priority, with main thread jobs alongside high.
+*/
+static int _ga_job_pending_rank(void* pending)
+{
+	if ((reinterpret_cast<uintptr_t>(pending) & k_resume_tag) ||
+		static_cast<ga_job_decl_t*>(pending)->_entry == _ga_job_resume_inline)
+	{
+		return 0;
+	}
+
+	ga_job_priority_t priority = _ga_job_pending_priority(pending);
+	return 1 + (priority == k_job_priority_main_thread ? k_job_priority_high : priority);
+}
+
+/* Whether pending work may be picked yet. Inline jobs carry on innermost first. */
+static bool _ga_job_pending_is_ready(void* pending)
+{
+	if (!(reinterpret_cast<uintptr_t>(pending) & k_resume_tag) &&
+		static_cast<ga_job_decl_t*>(pending)->_entry == _ga_job_resume_inline)
+	{
+		ga_job_worker_t* worker = static_cast<ga_job_worker_t*>(static_cast<ga_job_decl_t*>(pending)->_data);
+		return worker->_inline_waits.back() == pending;
+	}
+	return true;
+}
+
+/*
+** The worker pending work has to run on, or -1 if any worker thread will do.
+** Inline jobs resume on the worker that was running them.
+*/
+static int _ga_job_pending_worker(ga_job_system_impl_t* impl, void* pending)
+{
+	if (!(reinterpret_cast<uintptr_t>(pending) & k_resume_tag) &&
+		static_cast<ga_job_decl_t*>(pending)->_entry == _ga_job_resume_inline)
+	{
+		return static_cast<ga_job_worker_t*>(static_cast<ga_job_decl_t*>(pending)->_data)->_index;
+	}
+	if (_ga_job_pending_priority(pending) == k_job_priority_main_thread || impl->_workers.size() == 1)
+	{
+		return 0;
+	}
+	return -1;
+}
+
+static uint32_t _ga_job_next_random(ga_job_system_impl_t* impl)
+{
+	impl->_random ^= impl->_random << 13;
+	impl->_random ^= impl->_random >> 17;
+	impl->_random ^= impl->_random << 5;
+	return impl->_random;
+}
+
+/*
+** Adds decls to deterministic mode's pending list, and picks what runs next
+** if nothing is running. They go in together, so the pick sees them all.
+*/
+static void _ga_job_queue_deterministic(ga_job_system_impl_t* impl, ga_job_decl_t* decls, int decl_count)
+{
+	std::lock_guard<std::mutex> lock(impl->_deterministic_mutex);
+	for (int i = 0; i < decl_count; ++i)
+	{
+		impl->_pending[_ga_job_pending_rank(decls + i)].push_back(decls + i);
+	}
+	_ga_job_pick_deterministic(impl);
+}
+
+/* As above, for a tagged instance to resume. */
+static void _ga_job_queue_deterministic(ga_job_system_impl_t* impl, void* pending)
+{
+	std::lock_guard<std::mutex> lock(impl->_deterministic_mutex);
+	impl->_pending[_ga_job_pending_rank(pending)].push_back(pending);
+	_ga_job_pick_deterministic(impl);
+}
+
+/*
+** Hands the next piece of pending work to a worker, unless a job is already
+** running. Follows the replayed schedule while it still fits, otherwise
+** picks at random among the best ranked work. Called with the lock held.
+*/
+static void _ga_job_pick_deterministic(ga_job_system_impl_t* impl)
+{
+	if (impl->_running)
+	{
+		return;
+	}
+
+	/* Only resumes can be held back, and they rank first. */
+	uint32_t ready_counts[k_pending_rank_count];
+	uint32_t ready_count = 0;
+	for (int i = 0; i < k_pending_rank_count; ++i)
+	{
+		ready_counts[i] = (uint32_t)impl->_pending[i].size();
+		if (i == 0)
+		{
+			ready_counts[i] = 0;
+			for (void* p : impl->_pending[i])
+			{
+				ready_counts[i] += _ga_job_pending_is_ready(p) ? 1 : 0;
+			}
+		}
+		ready_count += ready_counts[i];
+	}
+	if (ready_count == 0)
+	{
+		return;
+	}
+
+	uint32_t worker_count = (uint32_t)impl->_workers.size();
+	uint32_t rank = 0;
+	uint32_t index = 0;
+	uint32_t worker_index = 0;
+	bool picked = false;
+
+	if (impl->_replay_cursor < impl->_replay.size())
+	{
+		rank = impl->_replay[impl->_replay_cursor++];
+		index = impl->_replay[impl->_replay_cursor++];
+		worker_index = impl->_replay[impl->_replay_cursor++];
+
+		picked = rank < (uint32_t)k_pending_rank_count &&
+			index < impl->_pending[rank].size() &&
+			worker_index < worker_count &&
+			_ga_job_pending_is_ready(impl->_pending[rank][index]);
+		if (picked)
+		{
+			int required = _ga_job_pending_worker(impl, impl->_pending[rank][index]);
+			picked = required >= 0 ? worker_index == (uint32_t)required : worker_index != 0;
+		}
+		if (!picked)
+		{
+			impl->_replay_diverged = true;
+			impl->_replay_cursor = impl->_replay.size();
+		}
+	}
+
+	/* Otherwise take a random piece of the best ranked work that's ready. */
+	for (uint32_t i = 0; !picked && i < (uint32_t)k_pending_rank_count; ++i)
+	{
+		std::vector<void*>& pending = impl->_pending[i];
+		if (ready_counts[i] == 0)
+		{
+			continue;
+		}
+
+		uint32_t choice = _ga_job_next_random(impl) % ready_counts[i];
+		index = choice;
+		if (i == 0)
+		{
+			for (index = 0; index < pending.size(); ++index)
+			{
+				if (_ga_job_pending_is_ready(pending[index]) && choice-- == 0)
+				{
+					break;
+				}
+			}
+		}
+
+		int required = _ga_job_pending_worker(impl, pending[index]);
+		worker_index = required >= 0 ? (uint32_t)required : 1 + _ga_job_next_random(impl) % (worker_count - 1);
+		rank = i;
+		picked = true;
+	}
+
+	if (!picked)
+	{
+		return;
+	}
+
+	/* FNV-1a over every choice, so equal runs have equal hashes. */
+	uint32_t choice[3] = { rank, index, worker_index };
+	for (uint32_t value : choice)
+	{
+		impl->_schedule.push_back(value);
+		for (int byte = 0; byte < 4; ++byte)
+		{
+			impl->_schedule_hash = (impl->_schedule_hash ^ ((value >> (byte * 8)) & 0xff)) * 16777619u;
+		}
+	}
+
+	/* Order within a rank doesn't matter, only that it's the same every run. */
+	std::vector<void*>& pending = impl->_pending[rank];
+	void* work = pending[index];
+	pending[index] = pending.back();
+	pending.pop_back();
+	impl->_running = true;
+
+	ga_job_worker_t* worker = impl->_workers[worker_index];
+	if (!(reinterpret_cast<uintptr_t>(work) & k_resume_tag) &&
+		static_cast<ga_job_decl_t*>(work)->_entry == _ga_job_resume_inline)
+	{
+		worker->_inline_waits.pop_back();
+	}
+	worker->_assigned.store(work, std::memory_order_release);
+	_ga_job_wake_worker(worker);
+}
+
+/*
+** Runs whatever the worker was picked for, then lets the next pick happen.
+** Returns false if it wasn't picked for anything.
+*/
+static bool _ga_job_run_deterministic(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_fiber* parent_fiber)
+{
+	void* pending = worker->_assigned.exchange(0, std::memory_order_acq_rel);
+	if (!pending)
+	{
+		return false;
+	}
+
+	_ga_job_run_assigned(impl, worker, parent_fiber, pending);
+	return true;
+}
+
+static void _ga_job_run_assigned(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_fiber* parent_fiber, void* pending)
+{
+	if (reinterpret_cast<uintptr_t>(pending) & k_resume_tag)
+	{
+		_ga_job_run(impl, parent_fiber, reinterpret_cast<ga_job_instance_t*>(reinterpret_cast<uintptr_t>(pending) & ~k_resume_tag));
+	}
+	else
+	{
+		ga_job_decl_t* decl = static_cast<ga_job_decl_t*>(pending);
+		ga_job_instance_t* job = _ga_job_alloc_instance(impl, decl->_stack);
+		if (job)
+		{
+			job->_decl = *decl;
+			_ga_job_run(impl, parent_fiber, job);
+		}
+		else
+		{
+			++worker->_inline_depth;
+			_ga_job_run_inline(impl, decl);
+			--worker->_inline_depth;
+		}
+	}
+
+	/* The job has finished or is waiting, so another can run. */
+	std::lock_guard<std::mutex> lock(impl->_deterministic_mutex);
+	impl->_running = false;
+	_ga_job_pick_deterministic(impl);
+}
+
+/*
+** Waits from a job running inline in deterministic mode. The job can't
+** switch out, so it lets other jobs run on this worker in the meantime, and
+** is picked to carry on like any other pending work once the counter is done.
+*/
+static void _ga_job_wait_inline_deterministic(ga_job_system_impl_t* impl, ga_job_worker_t* worker, ga_job_counter_t* counter)
+{
+	ga_job_decl_t resume_decl;
+	resume_decl._entry = _ga_job_resume_inline;
+	resume_decl._data = worker;
+
+	ga_job_continuation_t resume;
+	resume._decl = &resume_decl;
+
+	{
+		std::lock_guard<std::mutex> lock(impl->_deterministic_mutex);
+		worker->_inline_waits.push_back(&resume_decl);
+	}
+	ga_job::submit_when_done(counter, &resume);
+
+	{
+		std::lock_guard<std::mutex> lock(impl->_deterministic_mutex);
+		impl->_running = false;
+		_ga_job_pick_deterministic(impl);
+	}
+
+	for (;;)
+	{
+		void* pending = worker->_assigned.exchange(0, std::memory_order_acq_rel);
+		if (pending == &resume_decl)
+		{
+			return;
+		}
+
+		if (pending)
+		{
+			_ga_job_run_assigned(impl, worker, &worker->_thread_fiber, pending);
+		}
+		else
+		{
+			_ga_job_idle(impl, worker, 0);
+		}
+	}
+}
+
+/* Marks an inline job's turn to carry on. Never actually run. */
+static void _ga_job_resume_inline(void* data)
+{
+}
+
+/*
+** Loads a schedule written by ga_job::write_schedule to replay, along with
+** the seed and worker count it was recorded with.
+*/
+static bool _ga_job_read_schedule(ga_job_system_impl_t* impl, const char* path, uint32_t* seed, int* worker_count)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+	{
+		return false;
+	}
+
+	uint32_t header[5];
+	bool read = fread(header, sizeof(header), 1, file) == 1 &&
+		header[0] == k_schedule_magic &&
+		header[1] == k_schedule_version;
+	if (read)
+	{
+		impl->_replay.resize(size_t(header[4]) * 3);
+		read = impl->_replay.empty() ||
+			fread(impl->_replay.data(), sizeof(uint32_t), impl->_replay.size(), file) == impl->_replay.size();
+	}
+	fclose(file);
+
+	if (!read)
+	{
+		impl->_replay.clear();
+		return false;
+	}
+
+	*seed = header[2];
+	*worker_count = (int)header[3];
+	return true;
 }
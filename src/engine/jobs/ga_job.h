@@ -11,22 +11,195 @@
 ** Based on: "Parallelizing the Naughty Dog Engine Using Fibers", Christian Gyrling
 */
 
+#include "ga_cpu_set.h"
+
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <new>
+#include <type_traits>
 
 /*
 ** Job entry point.
 */
 typedef void(*ga_job_function_t)(void* data);
 
+/*
+** Counts the unfinished jobs of a run.
+** Jobs that wait on a counter are kept in an intrusive list on the counter,
+** and whichever job brings the count to zero makes them all runnable. Nothing
+** polls. A counter that has nothing pending, including a new one, is done.
+*/
+struct ga_job_counter_t
+{
+	ga_job_counter_t() : _value(0), _waiters(done_marker()) {}
+
+	/* Starts counting value jobs. Nothing may be waiting on the counter. */
+	void reset(int32_t value)
+	{
+		_value.store(value, std::memory_order_relaxed);
+		_waiters.store(value > 0 ? 0 : done_marker(), std::memory_order_release);
+	}
+
+	bool is_done() const { return _waiters.load(std::memory_order_acquire) == done_marker(); }
+
+	static void* done_marker() { return reinterpret_cast<void*>(uintptr_t(1)); }
+
+	std::atomic<int32_t> _value;
+
+	/*
+	** Waiting job instances, or done_marker() once the count reaches zero.
+	** Swapping in the marker is the last thing the final job does with the
+	** counter, so the counter can be destroyed as soon as it is done.
+	*/
+	std::atomic<void*> _waiters;
+
+private:
+	ga_job_counter_t(const ga_job_counter_t&) = delete;
+	ga_job_counter_t& operator=(const ga_job_counter_t&) = delete;
+};
+
+/*
+** Which queue a job goes on.
+** Workers always take high priority jobs first. Low priority jobs are passed
+** over for normal ones, but get the first pick every so often so they can't
+** starve. Main thread jobs only ever run on the main thread, when it waits.
+*/
+enum ga_job_priority_t
+{
+	k_job_priority_high,
+	k_job_priority_normal,
+	k_job_priority_low,
+	k_job_priority_main_thread,
+
+	k_job_priority_count
+};
+
+/*
+** How much stack a job's fiber gets.
+** Each class has its own pool of fibers, created the first time they are
+** needed and reused after that, so a class only costs memory for as many of
+** its jobs as have been in flight at once. Stacks sit above a guard page.
+*/
+enum ga_job_stack_t
+{
+	k_job_stack_small,
+	k_job_stack_medium,
+	k_job_stack_large,
+
+	k_job_stack_count
+};
+
 /*
 ** Defines a job.
+** Read when the job starts, so it must live until then, but not after.
 */
 struct ga_job_decl_t
 {
+	ga_job_decl_t() : _entry(0), _data(0), _counter(0), _priority(k_job_priority_normal), _stack(k_job_stack_medium), _name(0) {}
+
 	ga_job_function_t _entry;
 	void* _data;
 
-	int32_t* _pending_count;
+	ga_job_counter_t* _counter;
+
+	ga_job_priority_t _priority;
+	ga_job_stack_t _stack;
+
+	/* What the job shows up as in traces. Must outlive the job; usually a literal. */
+	const char* _name;
+};
+
+/*
+** A job to queue once a counter reaches zero.
+** Nothing waits in the meantime, so no fiber is held. The continuation and
+** its decl must stay put until the job has started.
+*/
+struct ga_job_continuation_t
+{
+	ga_job_continuation_t() : _decl(0), _next(0) {}
+
+	ga_job_decl_t* _decl;
+
+	/* Next waiter on the same counter. Only the job system touches it. */
+	void* _next;
+};
+
+/*
+** Sizes of the job system's queues and fiber pools, and how it schedules.
+*/
+struct ga_job_config_t
+{
+	ga_job_config_t();
+
+	int _queue_size;
+
+	/* Most fibers each stack class may have at once, and their stack sizes in bytes. */
+	int _fiber_counts[k_job_stack_count];
+	size_t _stack_sizes[k_job_stack_count];
+
+	/*
+	** Deterministic mode, for runs that must be repeatable, such as A/B
+	** benchmark comparisons or bisecting a regression. Jobs run one at a
+	** time, and the choice of which runs next, and on which worker, comes
+	** from a generator seeded with _seed. Every choice is recorded, and a
+	** schedule written by write_schedule can be replayed from _replay_path,
+	** which also restores the seed and worker count it was recorded with.
+	**
+	** The cpu set is ignored: there are _worker_count unpinned worker
+	** threads besides the main thread. Runs schedule alike as long as jobs
+	** are only submitted from jobs, or while no jobs are running. Code
+	** outside jobs still runs alongside them.
+	*/
+	bool _deterministic;
+	uint32_t _seed;
+	int _worker_count;
+	const char* _replay_path;
+};
+
+/*
+** Callable over an index range, used by parallel_for.
+** The callable's captures are copied into inline storage, so wrapping a
+** lambda never allocates. Captures that don't fit fail to compile.
+*/
+class ga_job_callable
+{
+public:
+	template<typename F>
+	explicit ga_job_callable(const F& func)
+	{
+		static_assert(sizeof(F) <= k_storage_size, "Callable captures too much state for ga_job_callable.");
+		static_assert(alignof(F) <= k_storage_align, "Callable is over-aligned for ga_job_callable.");
+
+		new (&_storage) F(func);
+		_invoke = [](const void* storage, int begin, int end)
+		{
+			const F& f = *static_cast<const F*>(storage);
+			for (int i = begin; i < end; ++i)
+			{
+				f(i);
+			}
+		};
+		_destroy = [](void* storage)
+		{
+			static_cast<F*>(storage)->~F();
+		};
+	}
+
+	~ga_job_callable() { _destroy(&_storage); }
+
+	void operator()(int begin, int end) const { _invoke(&_storage, begin, end); }
+
+private:
+	ga_job_callable(const ga_job_callable&) = delete;
+	ga_job_callable& operator=(const ga_job_callable&) = delete;
+
+	static const size_t k_storage_size = 64;
+	static const size_t k_storage_align = 16;
+
+	typename std::aligned_storage<k_storage_size, k_storage_align>::type _storage;
+	void(*_invoke)(const void* storage, int begin, int end);
+	void(*_destroy)(void* storage);
 };
 
 /*
@@ -35,6 +208,21 @@ struct ga_job_decl_t
 class ga_job
 {
 public:
+	/*
+	** Starts a worker on each hardware thread in cpus, pinned to it. The
+	** calling thread becomes the main thread, and runs jobs while it waits.
+	*/
+	static void startup(
+		const ga_cpu_set& cpus,
+		const ga_job_config_t& config);
+
+	/* As above, with fiber_count medium stacks and default small and large pools. */
+	static void startup(
+		const ga_cpu_set& cpus,
+		int queue_size,
+		int fiber_count);
+
+	/* As above, with the hardware threads picked by a bit mask. */
 	static void startup(
 		uint32_t hardware_thread_mask,
 		int queue_size,
@@ -42,10 +230,205 @@ public:
 
 	static void shutdown();
 
-	static void run(ga_job_decl_t* decls, int decl_count, int32_t* counter);
+	static void run(ga_job_decl_t* decls, int decl_count, ga_job_counter_t* counter);
+
+	/*
+	** Queues jobs whose _counter was already set up by the caller, leaving
+	** the counter alone. Used to start continuations.
+	*/
+	static void submit(ga_job_decl_t* decls, int decl_count);
+
+	static void wait(ga_job_counter_t* counter);
+
+	/*
+	** Queues the continuation's job once the counter reaches zero, or right
+	** away if it already has, as submit would. Its _counter is left alone.
+	*/
+	static void submit_when_done(ga_job_counter_t* counter, ga_job_continuation_t* continuation);
+
+	/*
+	** Counts one of the counter's jobs as finished without running one,
+	** resuming its waiters if it was the last. With a count of one, this
+	** makes a counter an event jobs can wait for.
+	*/
+	static void signal(ga_job_counter_t* counter);
 
-	static void wait(int32_t* counter);
+	/*
+	** Calls func(i) for every i in [begin, end), in parallel, returning once
+	** all calls are done. The range is split in half recursively until pieces
+	** are at most grain long. A grain of zero or less picks one from the
+	** worker count. Pieces run at the priority and stack class of the calling
+	** job.
+	*/
+	template<typename F>
+	static void parallel_for(int begin, int end, int grain, const F& func)
+	{
+		ga_job_callable body(func);
+		parallel_for_callable(begin, end, grain, body);
+	}
+
+	/*
+	** Folds func over [begin, end) in parallel and returns the result. Each
+	** piece of at most grain indices starts a partial from identity and calls
+	** func(i, partial) for each of its indices. The partials are then folded
+	** with combine(a, b) in index order, so the result doesn't depend on which
+	** worker ran what. A grain of zero or less picks one from the worker count.
+	**
+	** Partials are kept in cache line padded slots on the caller's stack, so
+	** the range is never cut into more than k_max_reduce_pieces pieces. T must
+	** be default constructible.
+	*/
+	template<typename T, typename F, typename C>
+	static T parallel_reduce(int begin, int end, int grain, const T& identity, const F& func, const C& combine)
+	{
+		int count = end - begin;
+		int piece_size = get_reduce_piece_size(count, grain);
+		int piece_count = count > 0 ? (count + piece_size - 1) / piece_size : 0;
+		if (piece_count <= 1)
+		{
+			T partial = identity;
+			for (int i = begin; i < end; ++i)
+			{
+				func(i, partial);
+			}
+			return partial;
+		}
+
+		reduce_slot_t<T> slots[k_max_reduce_pieces];
+		parallel_for(0, piece_count, 1, [&](int piece)
+		{
+			int piece_begin = begin + piece * piece_size;
+			int piece_end = piece_begin + piece_size < end ? piece_begin + piece_size : end;
+
+			T partial = identity;
+			for (int i = piece_begin; i < piece_end; ++i)
+			{
+				func(i, partial);
+			}
+			slots[piece]._value = partial;
+		});
+
+		T result = slots[0]._value;
+		for (int piece = 1; piece < piece_count; ++piece)
+		{
+			result = combine(result, slots[piece]._value);
+		}
+		return result;
+	}
+
+	/*
+	** Writes the exclusive prefix fold of input to output: output[0] is
+	** identity, and output[i] is input[0] through input[i - 1] folded with
+	** combine. Output may be the same array as input. Runs as two parallel
+	** passes over pieces of at most grain elements, with the same piece
+	** rules as parallel_reduce.
+	*/
+	template<typename T, typename C>
+	static void parallel_exclusive_scan(const T* input, T* output, int count, int grain, const T& identity, const C& combine)
+	{
+		int piece_size = get_reduce_piece_size(count, grain);
+		int piece_count = count > 0 ? (count + piece_size - 1) / piece_size : 0;
+		if (piece_count <= 1)
+		{
+			T running = identity;
+			for (int i = 0; i < count; ++i)
+			{
+				T value = input[i];
+				output[i] = running;
+				running = combine(running, value);
+			}
+			return;
+		}
+
+		/* Total each piece, then scan the totals to find where each piece starts. */
+		reduce_slot_t<T> slots[k_max_reduce_pieces];
+		parallel_for(0, piece_count, 1, [&](int piece)
+		{
+			int piece_begin = piece * piece_size;
+			int piece_end = piece_begin + piece_size < count ? piece_begin + piece_size : count;
+
+			T total = identity;
+			for (int i = piece_begin; i < piece_end; ++i)
+			{
+				total = combine(total, input[i]);
+			}
+			slots[piece]._value = total;
+		});
+
+		T running = identity;
+		for (int piece = 0; piece < piece_count; ++piece)
+		{
+			T total = slots[piece]._value;
+			slots[piece]._value = running;
+			running = combine(running, total);
+		}
+
+		parallel_for(0, piece_count, 1, [&](int piece)
+		{
+			int piece_begin = piece * piece_size;
+			int piece_end = piece_begin + piece_size < count ? piece_begin + piece_size : count;
+
+			T running = slots[piece]._value;
+			for (int i = piece_begin; i < piece_end; ++i)
+			{
+				T value = input[i];
+				output[i] = running;
+				running = combine(running, value);
+			}
+		});
+	}
+
+	/*
+	** Sets how many times an idle worker checks for work, pausing between
+	** checks, before it parks and waits to be woken. Zero parks straight away.
+	*/
+	static void set_idle_spin_count(int count);
+
+	static int get_worker_count();
+
+	/*
+	** Index of the worker running the caller, from zero up to the worker
+	** count, or -1 on threads that aren't workers. A job can resume on a
+	** different worker after waiting, so look it up again after any wait.
+	*/
+	static int get_worker_index();
+
+	/*
+	** Most stack any fiber of a class has used so far, in bytes, or zero where
+	** the platform can't tell. For tuning stack sizes; call it while no jobs
+	** of that class are running.
+	*/
+	static size_t get_stack_high_water(ga_job_stack_t stack);
+
+	/*
+	** Writes the choices deterministic mode has made so far, for replaying
+	** through ga_job_config_t::_replay_path. Fails outside deterministic mode.
+	*/
+	static bool write_schedule(const char* path);
+
+	/*
+	** Hash of the choices deterministic mode has made so far. Runs that
+	** scheduled alike have the same hash.
+	*/
+	static uint32_t get_schedule_hash();
+
+	/* Whether a replay couldn't be read, or stopped matching its schedule and went back to the seed. */
+	static bool has_replay_diverged();
+
+	static const int k_max_reduce_pieces = 64;
 
 private:
+	static void parallel_for_callable(int begin, int end, int grain, const ga_job_callable& body);
+
+	/* Piece length for a reduce or scan over count elements. */
+	static int get_reduce_piece_size(int count, int grain);
+
+	/* A partial result, aligned so neighbouring pieces don't share a cache line. */
+	template<typename T>
+	struct alignas(64) reduce_slot_t
+	{
+		T _value;
+	};
+
 	static void* _impl;
 };
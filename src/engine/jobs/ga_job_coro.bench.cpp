@@ -0,0 +1,254 @@
+/**
+* Microbenchmarks for jobs written as coroutines.
+* Measures how long tasks take to start and finish, multi-stage pipelines
+* that suspend on a group of jobs per stage, and tasks suspended on a
+* counter that other jobs signal. Every task counts the stages it got
+* through, and the run fails if any pipeline skipped or repeated one.
+* Results are printed, and written as JSON so runs can be compared.
+*
+* Needs a compiler with C++20 coroutines; the rest of the engine doesn't.
+*
+* Usage: ga_job_coro_bench [output json] [scale]
+**/
+
+#include "ga_job_coro.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct bench_result_t
+{
+	std::string _name;
+	int _param;
+	uint64_t _ops;
+	double _seconds;
+};
+
+static std::vector<bench_result_t> g_results;
+static double g_scale = 1.0;
+static int g_worker_count = 0;
+static bool g_failed = false;
+
+static double seconds_since(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::duration<double>>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+static uint64_t scaled(uint64_t count)
+{
+	uint64_t result = uint64_t(count * g_scale);
+	return result > 0 ? result : 1;
+}
+
+static void report(const char* name, int param, uint64_t ops, double seconds)
+{
+	bench_result_t result;
+	result._name = name;
+	result._param = param;
+	result._ops = ops;
+	result._seconds = seconds;
+	g_results.push_back(result);
+
+	printf("%-18s %6d %10llu ops %12.1f ns/op\n", name, param, (unsigned long long)ops, seconds * 1e9 / ops);
+}
+
+static void check(bool condition, const char* name)
+{
+	if (!condition)
+	{
+		printf("%s gave the wrong result.\n", name);
+		g_failed = true;
+	}
+}
+
+static std::atomic<uint64_t> g_job_count(0);
+
+static void counted_job(void* data)
+{
+	g_job_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+static ga_job_task empty_task(int* stages)
+{
+	++*stages;
+	co_return;
+}
+
+// Time from starting n tasks that don't suspend to all of them having finished.
+static void bench_task_start()
+{
+	for (int n = 1; n <= 1000; n *= 10)
+	{
+		std::vector<ga_job_counter_t> counters(n);
+		std::vector<int> stages(n);
+
+		uint64_t rounds = scaled(20000 / n + 10);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint64_t i = 0; i < rounds; ++i)
+		{
+			for (int t = 0; t < n; ++t)
+			{
+				empty_task(&stages[t]).start(&counters[t]);
+			}
+			for (int t = 0; t < n; ++t)
+			{
+				ga_job::wait(&counters[t]);
+			}
+		}
+		report("task_start", n, rounds * n, seconds_since(start));
+
+		bool complete = true;
+		for (int t = 0; t < n; ++t)
+		{
+			complete = complete && stages[t] == int(rounds);
+		}
+		check(complete, "task_start");
+	}
+}
+
+// Each stage fans out a group of jobs and suspends the task until they finish.
+static ga_job_task pipeline_task(ga_job_decl_t* decls, int decl_count, int stage_count, int* stages)
+{
+	for (int stage = 0; stage < stage_count; ++stage)
+	{
+		co_await ga_job_task::run(decls, decl_count);
+		++*stages;
+	}
+}
+
+static void bench_task_pipeline()
+{
+	const int k_task_count = 64;
+	const int k_jobs_per_stage = 16;
+
+	// Every task gets its own decls, since a group may still be running them when another starts.
+	std::vector<ga_job_decl_t> decls(k_task_count * k_jobs_per_stage);
+	for (auto& decl : decls)
+	{
+		decl._entry = counted_job;
+	}
+
+	for (int stage_count = 1; stage_count <= 16; stage_count *= 4)
+	{
+		std::vector<ga_job_counter_t> counters(k_task_count);
+		std::vector<int> stages(k_task_count);
+		g_job_count.store(0);
+
+		uint64_t rounds = scaled(2000 / stage_count + 10);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint64_t i = 0; i < rounds; ++i)
+		{
+			for (int t = 0; t < k_task_count; ++t)
+			{
+				pipeline_task(&decls[t * k_jobs_per_stage], k_jobs_per_stage, stage_count, &stages[t]).start(&counters[t]);
+			}
+			for (int t = 0; t < k_task_count; ++t)
+			{
+				ga_job::wait(&counters[t]);
+			}
+		}
+		report("task_pipeline", stage_count, rounds * k_task_count * stage_count, seconds_since(start));
+
+		bool complete = g_job_count.load() == rounds * k_task_count * stage_count * k_jobs_per_stage;
+		for (int t = 0; t < k_task_count; ++t)
+		{
+			complete = complete && stages[t] == int(rounds) * stage_count;
+		}
+		check(complete, "task_pipeline");
+	}
+}
+
+// A task suspended on a counter that jobs it didn't start bring to zero.
+static ga_job_task wait_task(ga_job_counter_t* counter, int* stages)
+{
+	co_await ga_job_task::wait(counter);
+	++*stages;
+}
+
+static void bench_task_wait()
+{
+	for (int n = 1; n <= 1000; n *= 10)
+	{
+		ga_job_counter_t job_counter;
+		std::vector<ga_job_decl_t> decls(n);
+		for (auto& decl : decls)
+		{
+			decl._entry = counted_job;
+			decl._counter = &job_counter;
+		}
+
+		int stages = 0;
+		g_job_count.store(0);
+
+		uint64_t rounds = scaled(20000 / n + 10);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint64_t i = 0; i < rounds; ++i)
+		{
+			// The counter is set before the task starts, so it can't see the last round's zero.
+			ga_job_counter_t task_counter;
+			job_counter.reset(n);
+			wait_task(&job_counter, &stages).start(&task_counter);
+			ga_job::submit(decls.data(), n);
+			ga_job::wait(&task_counter);
+		}
+		report("task_wait", n, rounds, seconds_since(start));
+
+		check(stages == int(rounds) && g_job_count.load() == rounds * n, "task_wait");
+	}
+}
+
+static bool write_json(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		return false;
+	}
+
+	fprintf(file, "{\n\t\"worker_count\": %d,\n\t\"scale\": %g,\n\t\"results\": [\n", g_worker_count, g_scale);
+	for (size_t i = 0; i < g_results.size(); ++i)
+	{
+		const bench_result_t& result = g_results[i];
+		fprintf(file, "\t\t{ \"name\": \"%s\", \"param\": %d, \"ops\": %llu, \"seconds\": %.9f, \"ns_per_op\": %.3f }%s\n",
+			result._name.c_str(), result._param, (unsigned long long)result._ops, result._seconds,
+			result._seconds * 1e9 / result._ops, i + 1 < g_results.size() ? "," : "");
+	}
+	fprintf(file, "\t]\n}\n");
+
+	return fclose(file) == 0;
+}
+
+int main(int argc, const char** argv)
+{
+	const char* json_path = argc > 1 ? argv[1] : "ga_job_coro_bench.json";
+	g_scale = argc > 2 ? atof(argv[2]) : 1.0;
+
+	// Room for every task and its jobs to be queued at once.
+	ga_job_config_t config;
+	config._queue_size = 16 * 1024;
+
+	ga_cpu_set worker_cpus = ga_cpu_set::all();
+	worker_cpus.clear(0);
+	ga_job::startup(worker_cpus, config);
+
+	g_worker_count = ga_job::get_worker_count();
+	printf("%d workers\n", g_worker_count);
+	bench_task_start();
+	bench_task_pipeline();
+	bench_task_wait();
+
+	ga_job::shutdown();
+
+	if (!write_json(json_path))
+	{
+		printf("Couldn't write %s.\n", json_path);
+		return 1;
+	}
+	return g_failed ? 1 : 0;
+}
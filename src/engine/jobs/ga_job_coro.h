@@ -0,0 +1,169 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_job.h"
+
+/*
+** Jobs written as C++20 coroutines. Only available when the compiler
+** supports coroutines; the engine itself still builds as C++11.
+*/
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+
+/*
+** A job that can suspend part way through.
+** Awaiting a counter, or a group of jobs, suspends the coroutine without
+** holding a fiber: its frame is queued as a continuation on the counter, and
+** resumed as a new job on whichever worker picks it up. Multi-stage work can
+** be written as one function, with each stage only costing its frame.
+**
+**	ga_job_task load(asset_t* asset)
+**	{
+**		co_await ga_job_task::run(&read_decl, 1);
+**		co_await ga_job_task::run(decode_decls, decode_count);
+**		co_await ga_job_task::wait(&upload_counter);
+**	}
+**
+**	ga_job_counter_t counter;
+**	load(asset).start(&counter);
+**	ga_job::wait(&counter);
+**
+** Coroutines run like any other job between suspensions, so blocking calls
+** such as ga_job::wait still work in them, but hold a fiber while they wait.
+*/
+class ga_job_task
+{
+public:
+	struct promise_type;
+	typedef std::coroutine_handle<promise_type> handle_t;
+
+	struct promise_type
+	{
+		promise_type() : _counter(0)
+		{
+			_decl._entry = resume_job;
+			_decl._data = handle_t::from_promise(*this).address();
+			_decl._name = "ga_job_task";
+			_continuation._decl = &_decl;
+		}
+
+		ga_job_task get_return_object() { return ga_job_task(handle_t::from_promise(*this)); }
+
+		/* Tasks don't run until started. */
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		/* The frame is freed before the counter is signalled, so waiters can't see it half gone. */
+		struct final_awaiter_t
+		{
+			bool await_ready() noexcept { return false; }
+			void await_suspend(handle_t handle) noexcept
+			{
+				ga_job_counter_t* counter = handle.promise()._counter;
+				handle.destroy();
+				ga_job::signal(counter);
+			}
+			void await_resume() noexcept {}
+		};
+		final_awaiter_t final_suspend() noexcept { return {}; }
+
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+
+		/* Counts the task as one job; signalled when it finishes. */
+		ga_job_counter_t* _counter;
+
+		/* Queued to run the coroutine until its next suspension. */
+		ga_job_decl_t _decl;
+		ga_job_continuation_t _continuation;
+	};
+
+	ga_job_task(ga_job_task&& other) noexcept : _handle(other._handle) { other._handle = handle_t(); }
+	~ga_job_task()
+	{
+		if (_handle)
+		{
+			_handle.destroy();
+		}
+	}
+
+	/*
+	** Queues the task to start, counting it on counter like one job passed to
+	** ga_job::run. The task owns itself from then on.
+	*/
+	void start(ga_job_counter_t* counter, ga_job_priority_t priority = k_job_priority_normal)
+	{
+		handle_t handle = _handle;
+		_handle = handle_t();
+
+		counter->reset(1);
+		handle.promise()._counter = counter;
+		handle.promise()._decl._priority = priority;
+		ga_job::submit(&handle.promise()._decl, 1);
+	}
+
+	/* Suspends the task until a counter reaches zero. */
+	struct counter_awaiter_t
+	{
+		ga_job_counter_t* _counter;
+
+		bool await_ready() const { return _counter->is_done(); }
+		void await_suspend(handle_t handle)
+		{
+			/* May resume on another worker before this returns, so touch nothing after. */
+			ga_job::submit_when_done(_counter, &handle.promise()._continuation);
+		}
+		void await_resume() const {}
+	};
+
+	static counter_awaiter_t wait(ga_job_counter_t* counter) { return counter_awaiter_t{ counter }; }
+
+	/* Runs a group of jobs, suspending the task until they've all finished. */
+	struct group_awaiter_t
+	{
+		group_awaiter_t(ga_job_decl_t* decls, int decl_count) : _decls(decls), _decl_count(decl_count) {}
+
+		bool await_ready()
+		{
+			ga_job::run(_decls, _decl_count, &_counter);
+			return _counter.is_done();
+		}
+		void await_suspend(handle_t handle)
+		{
+			ga_job::submit_when_done(&_counter, &handle.promise()._continuation);
+		}
+		void await_resume() const {}
+
+		ga_job_decl_t* _decls;
+		int _decl_count;
+
+		/* Lives in the coroutine frame for as long as the task is suspended on it. */
+		ga_job_counter_t _counter;
+	};
+
+	static group_awaiter_t run(ga_job_decl_t* decls, int decl_count) { return group_awaiter_t(decls, decl_count); }
+
+private:
+	explicit ga_job_task(handle_t handle) : _handle(handle) {}
+
+	ga_job_task(const ga_job_task&) = delete;
+	ga_job_task& operator=(const ga_job_task&) = delete;
+
+	static void resume_job(void* data)
+	{
+		handle_t::from_address(data).resume();
+	}
+
+	handle_t _handle;
+};
+
+#endif
@@ -0,0 +1,186 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_job_graph.h"
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <utility>
+#include <vector>
+
+struct ga_job_graph_node_t
+{
+	/* What the scheduler runs. Its entry is _ga_job_graph_node. */
+	ga_job_decl_t _decl;
+
+	ga_job_function_t _entry;
+	void* _data;
+
+	struct ga_job_graph_impl_t* _graph;
+
+	int32_t _predecessor_count;
+
+	int _first_successor;
+	int _successor_count;
+};
+
+struct ga_job_graph_impl_t
+{
+	std::vector<ga_job_graph_node_t> _nodes;
+
+	/* Dependencies as added, and flattened into per-node successor lists by run. */
+	std::vector<std::pair<int, int>> _edges;
+	std::vector<int> _successors;
+
+	/*
+	** Per node, predecessors that haven't finished yet in the current run.
+	** Kept apart from the nodes so they can stay copyable in the vector.
+	*/
+	std::unique_ptr<std::atomic<int32_t>[]> _remaining;
+	size_t _remaining_size;
+};
+
+static void _ga_job_graph_node(void* data);
+
+ga_job_graph::ga_job_graph()
+{
+	ga_job_graph_impl_t* impl = new ga_job_graph_impl_t;
+	impl->_remaining_size = 0;
+	_impl = impl;
+}
+
+ga_job_graph::~ga_job_graph()
+{
+	delete static_cast<ga_job_graph_impl_t*>(_impl);
+}
+
+int ga_job_graph::add(ga_job_function_t entry, void* data, ga_job_priority_t priority, const char* name)
+{
+	ga_job_graph_impl_t* impl = static_cast<ga_job_graph_impl_t*>(_impl);
+
+	ga_job_graph_node_t node;
+	node._decl._entry = _ga_job_graph_node;
+	node._decl._data = 0;
+	node._decl._counter = 0;
+	node._decl._priority = priority;
+	node._decl._name = name;
+	node._entry = entry;
+	node._data = data;
+	node._graph = impl;
+	node._predecessor_count = 0;
+	node._first_successor = 0;
+	node._successor_count = 0;
+
+	impl->_nodes.push_back(node);
+	return (int)impl->_nodes.size() - 1;
+}
+
+void ga_job_graph::add_dependency(int before, int after)
+{
+	ga_job_graph_impl_t* impl = static_cast<ga_job_graph_impl_t*>(_impl);
+	assert(before >= 0 && before < (int)impl->_nodes.size());
+	assert(after >= 0 && after < (int)impl->_nodes.size());
+	assert(before != after);
+
+	impl->_edges.push_back(std::make_pair(before, after));
+}
+
+void ga_job_graph::clear()
+{
+	ga_job_graph_impl_t* impl = static_cast<ga_job_graph_impl_t*>(_impl);
+	impl->_nodes.clear();
+	impl->_edges.clear();
+	impl->_successors.clear();
+}
+
+void ga_job_graph::run(ga_job_counter_t* counter)
+{
+	ga_job_graph_impl_t* impl = static_cast<ga_job_graph_impl_t*>(_impl);
+	std::vector<ga_job_graph_node_t>& nodes = impl->_nodes;
+
+	counter->reset((int32_t)nodes.size());
+	if (nodes.empty())
+	{
+		return;
+	}
+
+	/* Count predecessors and successors, then lay successors out per node. */
+	for (auto& node : nodes)
+	{
+		node._predecessor_count = 0;
+		node._successor_count = 0;
+	}
+	for (auto& edge : impl->_edges)
+	{
+		nodes[edge.first]._successor_count++;
+		nodes[edge.second]._predecessor_count++;
+	}
+
+	int first = 0;
+	for (auto& node : nodes)
+	{
+		node._first_successor = first;
+		first += node._successor_count;
+		node._successor_count = 0;
+	}
+
+	impl->_successors.resize(impl->_edges.size());
+	for (auto& edge : impl->_edges)
+	{
+		ga_job_graph_node_t& node = nodes[edge.first];
+		impl->_successors[node._first_successor + node._successor_count++] = edge.second;
+	}
+
+	if (impl->_remaining_size < nodes.size())
+	{
+		impl->_remaining.reset(new std::atomic<int32_t>[nodes.size()]);
+		impl->_remaining_size = nodes.size();
+	}
+
+	/* Every node counts against the counter from the start. */
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		nodes[i]._decl._data = &nodes[i];
+		nodes[i]._decl._counter = counter;
+		impl->_remaining[i].store(nodes[i]._predecessor_count, std::memory_order_relaxed);
+	}
+
+	/* Nodes are queued last so none can finish while others are still being set up. */
+	for (auto& node : nodes)
+	{
+		if (node._predecessor_count == 0)
+		{
+			ga_job::submit(&node._decl, 1);
+		}
+	}
+}
+
+int ga_job_graph::get_count() const
+{
+	ga_job_graph_impl_t* impl = static_cast<ga_job_graph_impl_t*>(_impl);
+	return (int)impl->_nodes.size();
+}
+
+static void _ga_job_graph_node(void* data)
+{
+	ga_job_graph_node_t* node = static_cast<ga_job_graph_node_t*>(data);
+	node->_entry(node->_data);
+
+	/* The last predecessor to finish queues the successor. */
+	ga_job_graph_impl_t* impl = node->_graph;
+	for (int i = 0; i < node->_successor_count; ++i)
+	{
+		int successor = impl->_successors[node->_first_successor + i];
+		if (impl->_remaining[successor].fetch_sub(1, std::memory_order_acq_rel) == 1)
+		{
+			ga_job::submit(&impl->_nodes[successor]._decl, 1);
+		}
+	}
+}
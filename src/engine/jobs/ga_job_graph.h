@@ -0,0 +1,48 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_job.h"
+
+/*
+** A graph of jobs with dependencies between them.
+** Jobs with no predecessors are queued when the graph runs. Every other job
+** is queued by whichever of its predecessors finishes last, so a job that
+** isn't ready yet holds no fiber and nothing waits on it.
+**
+** A graph can be cleared and rebuilt each frame; it keeps its storage.
+** It must not be changed or run again until the previous run has finished.
+*/
+class ga_job_graph
+{
+public:
+	ga_job_graph();
+	~ga_job_graph();
+
+	/* Adds a job, returning its index in the graph. The name is for traces. */
+	int add(ga_job_function_t entry, void* data, ga_job_priority_t priority = k_job_priority_normal, const char* name = 0);
+
+	/* Makes the job at index after wait for the job at index before. */
+	void add_dependency(int before, int after);
+
+	/* Removes all jobs and dependencies. */
+	void clear();
+
+	/* Starts the graph. The counter reaches zero once every job has finished. */
+	void run(ga_job_counter_t* counter);
+
+	int get_count() const;
+
+private:
+	ga_job_graph(const ga_job_graph&) = delete;
+	ga_job_graph& operator=(const ga_job_graph&) = delete;
+
+	void* _impl;
+};
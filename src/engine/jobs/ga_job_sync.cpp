@@ -0,0 +1,313 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_job_sync.h"
+
+#include <cassert>
+#include <thread>
+
+static void _ga_job_sync_lock(std::atomic_flag& guard)
+{
+	while (guard.test_and_set(std::memory_order_acquire))
+	{
+		std::this_thread::yield();
+	}
+}
+
+static void _ga_job_sync_unlock(std::atomic_flag& guard)
+{
+	guard.clear(std::memory_order_release);
+}
+
+/*
+** Queues the caller and waits to be let through. The guard must be held,
+** and is released before waiting.
+*/
+static void _ga_job_sync_wait(std::atomic_flag& guard, ga_job_sync_queue_t& waiters, bool exclusive)
+{
+	ga_job_sync_waiter_t waiter;
+	waiter._counter.reset(1);
+	waiter._exclusive = exclusive;
+	waiters.push(&waiter);
+
+	_ga_job_sync_unlock(guard);
+
+	/* Parks the job, or has the main thread run others, until we're signalled. */
+	ga_job::wait(&waiter._counter);
+}
+
+/*
+** Lets a list of waiters go. Call with the guard released. A waiter may
+** return, and its stack entry vanish, as soon as it's signalled.
+*/
+static void _ga_job_sync_signal(ga_job_sync_waiter_t* waiter)
+{
+	while (waiter)
+	{
+		ga_job_sync_waiter_t* next = waiter->_next;
+		ga_job::signal(&waiter->_counter);
+		waiter = next;
+	}
+}
+
+void ga_job_sync_queue_t::push(ga_job_sync_waiter_t* waiter)
+{
+	waiter->_next = 0;
+	if (_tail)
+	{
+		_tail->_next = waiter;
+	}
+	else
+	{
+		_head = waiter;
+	}
+	_tail = waiter;
+}
+
+ga_job_sync_waiter_t* ga_job_sync_queue_t::pop()
+{
+	ga_job_sync_waiter_t* waiter = _head;
+	if (waiter)
+	{
+		_head = waiter->_next;
+		_tail = _head ? _tail : 0;
+		waiter->_next = 0;
+	}
+	return waiter;
+}
+
+ga_job_mutex::~ga_job_mutex()
+{
+	assert(!_locked && !_waiters._head);
+}
+
+void ga_job_mutex::lock()
+{
+	_ga_job_sync_lock(_guard);
+	if (!_locked)
+	{
+		_locked = true;
+		_ga_job_sync_unlock(_guard);
+		return;
+	}
+
+	/* Whoever unlocks hands the mutex to us, so it's ours once we wake. */
+	_ga_job_sync_wait(_guard, _waiters, true);
+}
+
+bool ga_job_mutex::try_lock()
+{
+	_ga_job_sync_lock(_guard);
+	bool locked = !_locked;
+	_locked = true;
+	_ga_job_sync_unlock(_guard);
+	return locked;
+}
+
+void ga_job_mutex::unlock()
+{
+	_ga_job_sync_lock(_guard);
+	assert(_locked);
+	ga_job_sync_waiter_t* waiter = _waiters.pop();
+	_locked = waiter != 0;
+	_ga_job_sync_unlock(_guard);
+
+	_ga_job_sync_signal(waiter);
+}
+
+ga_job_semaphore::~ga_job_semaphore()
+{
+	assert(!_waiters._head);
+}
+
+void ga_job_semaphore::acquire()
+{
+	_ga_job_sync_lock(_guard);
+	if (_count > 0)
+	{
+		--_count;
+		_ga_job_sync_unlock(_guard);
+		return;
+	}
+
+	/* Released counts go straight to waiters, so we hold ours once we wake. */
+	_ga_job_sync_wait(_guard, _waiters, true);
+}
+
+bool ga_job_semaphore::try_acquire()
+{
+	_ga_job_sync_lock(_guard);
+	bool acquired = _count > 0;
+	_count -= acquired ? 1 : 0;
+	_ga_job_sync_unlock(_guard);
+	return acquired;
+}
+
+void ga_job_semaphore::release(int count)
+{
+	ga_job_sync_waiter_t* woken = 0;
+	ga_job_sync_waiter_t** last = &woken;
+
+	_ga_job_sync_lock(_guard);
+	while (count > 0 && _waiters._head)
+	{
+		*last = _waiters.pop();
+		last = &(*last)->_next;
+		--count;
+	}
+	_count += count;
+	_ga_job_sync_unlock(_guard);
+
+	_ga_job_sync_signal(woken);
+}
+
+ga_job_event::~ga_job_event()
+{
+	assert(!_waiters._head);
+}
+
+void ga_job_event::wait()
+{
+	_ga_job_sync_lock(_guard);
+	if (_set)
+	{
+		_ga_job_sync_unlock(_guard);
+		return;
+	}
+
+	_ga_job_sync_wait(_guard, _waiters, false);
+}
+
+void ga_job_event::set()
+{
+	_ga_job_sync_lock(_guard);
+	_set = true;
+	ga_job_sync_waiter_t* woken = _waiters._head;
+	_waiters._head = 0;
+	_waiters._tail = 0;
+	_ga_job_sync_unlock(_guard);
+
+	_ga_job_sync_signal(woken);
+}
+
+void ga_job_event::reset()
+{
+	_ga_job_sync_lock(_guard);
+	_set = false;
+	_ga_job_sync_unlock(_guard);
+}
+
+bool ga_job_event::is_set()
+{
+	_ga_job_sync_lock(_guard);
+	bool set = _set;
+	_ga_job_sync_unlock(_guard);
+	return set;
+}
+
+ga_job_rwlock::~ga_job_rwlock()
+{
+	assert(!_writer && _reader_count == 0 && !_waiters._head);
+}
+
+void ga_job_rwlock::lock()
+{
+	_ga_job_sync_lock(_guard);
+	if (!_writer && _reader_count == 0 && !_waiters._head)
+	{
+		_writer = true;
+		_ga_job_sync_unlock(_guard);
+		return;
+	}
+
+	_ga_job_sync_wait(_guard, _waiters, true);
+}
+
+bool ga_job_rwlock::try_lock()
+{
+	_ga_job_sync_lock(_guard);
+	bool locked = !_writer && _reader_count == 0 && !_waiters._head;
+	_writer = _writer || locked;
+	_ga_job_sync_unlock(_guard);
+	return locked;
+}
+
+void ga_job_rwlock::unlock()
+{
+	_ga_job_sync_lock(_guard);
+	assert(_writer);
+	_writer = false;
+	ga_job_sync_waiter_t* woken = grant();
+	_ga_job_sync_unlock(_guard);
+
+	_ga_job_sync_signal(woken);
+}
+
+void ga_job_rwlock::lock_shared()
+{
+	_ga_job_sync_lock(_guard);
+	if (!_writer && !_waiters._head)
+	{
+		++_reader_count;
+		_ga_job_sync_unlock(_guard);
+		return;
+	}
+
+	_ga_job_sync_wait(_guard, _waiters, false);
+}
+
+bool ga_job_rwlock::try_lock_shared()
+{
+	_ga_job_sync_lock(_guard);
+	bool locked = !_writer && !_waiters._head;
+	_reader_count += locked ? 1 : 0;
+	_ga_job_sync_unlock(_guard);
+	return locked;
+}
+
+void ga_job_rwlock::unlock_shared()
+{
+	_ga_job_sync_lock(_guard);
+	assert(_reader_count > 0);
+	ga_job_sync_waiter_t* woken = --_reader_count == 0 ? grant() : 0;
+	_ga_job_sync_unlock(_guard);
+
+	_ga_job_sync_signal(woken);
+}
+
+ga_job_sync_waiter_t* ga_job_rwlock::grant()
+{
+	/* The lock passes to whoever is let in, so they hold it once they wake. */
+	ga_job_sync_waiter_t* head = _waiters._head;
+	if (!head || _writer)
+	{
+		return 0;
+	}
+
+	if (head->_exclusive)
+	{
+		if (_reader_count > 0)
+		{
+			return 0;
+		}
+		_writer = true;
+		return _waiters.pop();
+	}
+
+	/* Every reader up to the next writer goes in together. */
+	ga_job_sync_waiter_t* woken = 0;
+	ga_job_sync_waiter_t** last = &woken;
+	while (_waiters._head && !_waiters._head->_exclusive)
+	{
+		*last = _waiters.pop();
+		last = &(*last)->_next;
+		++_reader_count;
+	}
+	return woken;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_job.h"
+
+#include <atomic>
+#include <cstdint>
+
+/*
+** Blocking primitives for code running in jobs.
+** A job that has to wait is parked on the primitive and its worker goes on
+** to other jobs; it resumes, possibly on another thread, once it's let
+** through. The main thread runs jobs while it waits, and other threads block.
+**
+** Waiters are woken first come, first served, and a lock that's released to
+** a waiter is handed straight to it, so a busy lock can't starve anyone.
+** Each primitive keeps its state behind a short internal spin lock that is
+** never held across a wait.
+*/
+
+/* One waiter, living on the waiting job's stack. */
+struct ga_job_sync_waiter_t
+{
+	ga_job_counter_t _counter;
+	ga_job_sync_waiter_t* _next;
+	bool _exclusive;
+};
+
+/* First come, first served list of waiters. */
+struct ga_job_sync_queue_t
+{
+	ga_job_sync_queue_t() : _head(0), _tail(0) {}
+
+	void push(ga_job_sync_waiter_t* waiter);
+	ga_job_sync_waiter_t* pop();
+
+	ga_job_sync_waiter_t* _head;
+	ga_job_sync_waiter_t* _tail;
+};
+
+/*
+** Mutual exclusion between jobs.
+*/
+class ga_job_mutex
+{
+public:
+	ga_job_mutex() : _locked(false) { _guard.clear(); }
+	~ga_job_mutex();
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+private:
+	ga_job_mutex(const ga_job_mutex&) = delete;
+	ga_job_mutex& operator=(const ga_job_mutex&) = delete;
+
+	std::atomic_flag _guard;
+	bool _locked;
+	ga_job_sync_queue_t _waiters;
+};
+
+/*
+** Counting semaphore for jobs.
+*/
+class ga_job_semaphore
+{
+public:
+	explicit ga_job_semaphore(int count = 0) : _count(count) { _guard.clear(); }
+	~ga_job_semaphore();
+
+	/* Takes one from the count, waiting for it to be above zero. */
+	void acquire();
+	bool try_acquire();
+
+	void release(int count = 1);
+
+private:
+	ga_job_semaphore(const ga_job_semaphore&) = delete;
+	ga_job_semaphore& operator=(const ga_job_semaphore&) = delete;
+
+	std::atomic_flag _guard;
+	int _count;
+	ga_job_sync_queue_t _waiters;
+};
+
+/*
+** Manual reset event. Once set, waits return straight away until it's reset.
+*/
+class ga_job_event
+{
+public:
+	ga_job_event() : _set(false) { _guard.clear(); }
+	~ga_job_event();
+
+	void wait();
+	void set();
+	void reset();
+	bool is_set();
+
+private:
+	ga_job_event(const ga_job_event&) = delete;
+	ga_job_event& operator=(const ga_job_event&) = delete;
+
+	std::atomic_flag _guard;
+	bool _set;
+	ga_job_sync_queue_t _waiters;
+};
+
+/*
+** Reader/writer lock. Any number of readers, or one writer. Readers that
+** arrive while a writer is waiting queue behind it, so writers can't starve.
+*/
+class ga_job_rwlock
+{
+public:
+	ga_job_rwlock() : _reader_count(0), _writer(false) { _guard.clear(); }
+	~ga_job_rwlock();
+
+	void lock();
+	bool try_lock();
+	void unlock();
+
+	void lock_shared();
+	bool try_lock_shared();
+	void unlock_shared();
+
+private:
+	ga_job_rwlock(const ga_job_rwlock&) = delete;
+	ga_job_rwlock& operator=(const ga_job_rwlock&) = delete;
+
+	/* Lets in whoever is first in line, if they can go now. Returns them as a list to signal. */
+	ga_job_sync_waiter_t* grant();
+
+	std::atomic_flag _guard;
+	int32_t _reader_count;
+	bool _writer;
+	ga_job_sync_queue_t _waiters;
+};
@@ -0,0 +1,257 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_job_trace.h"
+
+#include "framework/ga_compiler_defines.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ga_job_trace_record_t
+{
+	uint64_t _time;
+	const char* _name;
+	const void* _id;
+	ga_job_trace_event_t _event;
+};
+
+/*
+** One thread's events.
+** Only the owning thread writes records. The ring is sized, and cleared,
+** under the trace mutex so a dump never sees it change shape.
+*/
+struct ga_job_trace_buffer_t
+{
+	std::vector<ga_job_trace_record_t> _records;
+	std::atomic<uint64_t> _count;
+
+	/* Recording session the ring was last set up for. */
+	uint32_t _session;
+
+	int _thread_id;
+	std::string _thread_name;
+};
+
+struct ga_job_trace_state_t
+{
+	std::mutex _mutex;
+
+	/* Buffers outlive their threads, so a dump still shows workers that have exited. */
+	std::vector<ga_job_trace_buffer_t*> _buffers;
+
+	std::atomic<bool> _recording;
+	std::atomic<uint32_t> _session;
+	int _event_count;
+	uint64_t _start_time;
+};
+
+static ga_job_trace_state_t& _ga_job_trace_get_state()
+{
+	static ga_job_trace_state_t state;
+	return state;
+}
+
+static uint64_t _ga_job_trace_now()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+** The calling thread's buffer, created on first use.
+** Jobs can resume on another thread after a wait, so only read this through
+** a call the compiler can't inline past a fiber switch.
+*/
+static thread_local ga_job_trace_buffer_t* t_buffer = 0;
+
+GA_NOINLINE static ga_job_trace_buffer_t* _ga_job_trace_get_buffer()
+{
+	if (!t_buffer)
+	{
+		ga_job_trace_state_t& state = _ga_job_trace_get_state();
+		std::lock_guard<std::mutex> lock(state._mutex);
+
+		ga_job_trace_buffer_t* buffer = new ga_job_trace_buffer_t;
+		buffer->_count = 0;
+		buffer->_session = 0;
+		buffer->_thread_id = (int)state._buffers.size();
+		state._buffers.push_back(buffer);
+
+		t_buffer = buffer;
+	}
+	return t_buffer;
+}
+
+void ga_job_trace::start(int event_count)
+{
+	ga_job_trace_state_t& state = _ga_job_trace_get_state();
+	std::lock_guard<std::mutex> lock(state._mutex);
+
+	/* Rings are a power of two so a wrapping count indexes them with a mask. */
+	int size = 1;
+	while (size < event_count)
+	{
+		size <<= 1;
+	}
+
+	state._event_count = size;
+	state._start_time = _ga_job_trace_now();
+	state._session.fetch_add(1, std::memory_order_relaxed);
+	state._recording.store(true, std::memory_order_release);
+}
+
+void ga_job_trace::stop()
+{
+	ga_job_trace_state_t& state = _ga_job_trace_get_state();
+	state._recording.store(false, std::memory_order_release);
+}
+
+bool ga_job_trace::is_recording()
+{
+	return _ga_job_trace_get_state()._recording.load(std::memory_order_relaxed);
+}
+
+void ga_job_trace::set_thread_name(const char* name)
+{
+	ga_job_trace_buffer_t* buffer = _ga_job_trace_get_buffer();
+
+	ga_job_trace_state_t& state = _ga_job_trace_get_state();
+	std::lock_guard<std::mutex> lock(state._mutex);
+	buffer->_thread_name = name;
+}
+
+void ga_job_trace::record(ga_job_trace_event_t event, const char* name, const void* id)
+{
+	ga_job_trace_state_t& state = _ga_job_trace_get_state();
+	if (!state._recording.load(std::memory_order_acquire))
+	{
+		return;
+	}
+
+	ga_job_trace_buffer_t* buffer = _ga_job_trace_get_buffer();
+
+	/* The first event of a session clears out the last one. */
+	uint32_t session = state._session.load(std::memory_order_relaxed);
+	if (buffer->_session != session)
+	{
+		std::lock_guard<std::mutex> lock(state._mutex);
+		buffer->_records.resize(state._event_count);
+		buffer->_count.store(0, std::memory_order_relaxed);
+		buffer->_session = session;
+	}
+
+	uint64_t count = buffer->_count.load(std::memory_order_relaxed);
+	ga_job_trace_record_t& record = buffer->_records[count & (buffer->_records.size() - 1)];
+	record._time = _ga_job_trace_now();
+	record._name = name;
+	record._id = id;
+	record._event = event;
+	buffer->_count.store(count + 1, std::memory_order_release);
+}
+
+static void _ga_job_trace_write_string(FILE* file, const char* str)
+{
+	fputc('"', file);
+	for (const char* c = str; *c; ++c)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			fputc('\\', file);
+			fputc(*c, file);
+		}
+		else if ((unsigned char)*c < 0x20)
+		{
+			fprintf(file, "\\u%04x", (unsigned)(unsigned char)*c);
+		}
+		else
+		{
+			fputc(*c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool ga_job_trace::write_chrome_json(const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+	{
+		return false;
+	}
+
+	ga_job_trace_state_t& state = _ga_job_trace_get_state();
+	std::lock_guard<std::mutex> lock(state._mutex);
+	uint32_t session = state._session.load(std::memory_order_relaxed);
+
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+	bool first = true;
+	for (auto& buffer : state._buffers)
+	{
+		if (!buffer->_thread_name.empty())
+		{
+			fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", buffer->_thread_id);
+			_ga_job_trace_write_string(file, buffer->_thread_name.c_str());
+			fprintf(file, "}}");
+			first = false;
+		}
+
+		if (buffer->_session != session)
+		{
+			continue;
+		}
+
+		/* Only the newest events survive once a ring has wrapped. */
+		uint64_t count = buffer->_count.load(std::memory_order_acquire);
+		uint64_t size = buffer->_records.size();
+		uint64_t begin = count > size ? count - size : 0;
+		for (uint64_t i = begin; i < count; ++i)
+		{
+			const ga_job_trace_record_t& record = buffer->_records[i & (size - 1)];
+			const char* name = record._name ? record._name : "job";
+			double time = record._time > state._start_time ? (record._time - state._start_time) / 1000.0 : 0.0;
+
+			const char* phase = "";
+			const char* category = "job";
+			switch (record._event)
+			{
+			case k_job_trace_run_begin: phase = "B"; break;
+			case k_job_trace_run_end: phase = "E"; break;
+			case k_job_trace_wait_begin: phase = "b"; category = "wait"; break;
+			case k_job_trace_wait_end: phase = "e"; category = "wait"; break;
+			case k_job_trace_steal: phase = "i"; category = "steal"; break;
+			case k_job_trace_idle_begin: phase = "B"; category = "idle"; name = "idle"; break;
+			case k_job_trace_idle_end: phase = "E"; category = "idle"; name = "idle"; break;
+			}
+
+			fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+			_ga_job_trace_write_string(file, name);
+			fprintf(file, ",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%d", category, phase, time, buffer->_thread_id);
+			if (record._event == k_job_trace_wait_begin || record._event == k_job_trace_wait_end)
+			{
+				/* Waits begin and end on different threads, so they're async events matched by id. */
+				fprintf(file, ",\"id\":\"0x%llx\"", (unsigned long long)(uintptr_t)record._id);
+			}
+			else if (record._event == k_job_trace_steal)
+			{
+				fprintf(file, ",\"s\":\"t\"");
+			}
+			fprintf(file, "}");
+			first = false;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	return fclose(file) == 0;
+}
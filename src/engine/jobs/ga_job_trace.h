@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include <cstdint>
+
+/*
+** Things the job system records while tracing.
+*/
+enum ga_job_trace_event_t
+{
+	/* A job's fiber is switched to, and back from. */
+	k_job_trace_run_begin,
+	k_job_trace_run_end,
+
+	/* A job stops to wait on a counter, and is resumed once it's done. */
+	k_job_trace_wait_begin,
+	k_job_trace_wait_end,
+
+	/* A worker takes a job off another worker's deque. */
+	k_job_trace_steal,
+
+	/* A worker finds nothing to do, and later goes back to work. */
+	k_job_trace_idle_begin,
+	k_job_trace_idle_end,
+};
+
+/*
+** Records what the job system does, for viewing on a timeline.
+** Each thread writes into its own ring of events, which keeps the most recent
+** ones and takes no locks. Recording only happens in builds with GA_JOB_TRACE
+** defined, and then only between start and stop; other builds compile it out.
+**
+** Events are tagged with the _name of the job's decl.
+*/
+class ga_job_trace
+{
+public:
+	/* Clears what was recorded, and records up to event_count events per thread from now on. */
+	static void start(int event_count);
+
+	static void stop();
+
+	static bool is_recording();
+
+	/*
+	** Writes everything recorded as Chrome trace JSON, which chrome://tracing
+	** and ui.perfetto.dev both open. Threads still recording may have their
+	** newest events overwritten while it's written, so stop first for an
+	** exact picture.
+	*/
+	static bool write_chrome_json(const char* path);
+
+	/* Names the calling thread in the trace. */
+	static void set_thread_name(const char* name);
+
+	/* Adds an event for the calling thread. id ties a wait's begin to its end. */
+	static void record(ga_job_trace_event_t event, const char* name, const void* id);
+};
+
+#if defined(GA_JOB_TRACE)
+#define GA_JOB_TRACE_EVENT(event, name, id) \
+	do { if (ga_job_trace::is_recording()) ga_job_trace::record(event, name, id); } while (0)
+#else
+#define GA_JOB_TRACE_EVENT(event, name, id) do {} while (0)
+#endif
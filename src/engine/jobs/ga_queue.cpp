@@ -10,74 +10,65 @@
 #include "ga_queue.h"
 
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <new>
+#include <thread>
 
-struct ga_queue_nodecount_t
-{
-	uint32_t _index;
-	uint32_t _count;
-};
-
-union ga_queue_pointer_t
-{
-	std::atomic<uint64_t> _atomic;
-
-	uint64_t _entire;
-	ga_queue_nodecount_t _part;
+static const size_t k_cache_line_size = 64;
 
-	ga_queue_pointer_t() {}
-	ga_queue_pointer_t(const ga_queue_pointer_t& other) : _entire(other._entire) {}
-	ga_queue_pointer_t& operator=(const ga_queue_pointer_t& other) { _entire = other._entire; return *this; }
-};
-
-struct ga_queue_node_t
+/*
+** A slot's sequence says whose turn it is. It equals the position when the
+** slot is free for the push at that position, and position + 1 once it holds
+** data for the pop at that position.
+*/
+struct ga_queue_slot_t
 {
+	std::atomic<uint64_t> _sequence;
 	void* _data;
-	ga_queue_pointer_t _next;
+	char _pad[k_cache_line_size - sizeof(std::atomic<uint64_t>) - sizeof(void*)];
 };
 
 struct ga_queue_impl_t
 {
-	ga_queue_pointer_t _head;
-	ga_queue_pointer_t _tail;
-	ga_queue_pointer_t _free_list;
+	/* Producers and consumers each get their own cache line. */
+	std::atomic<uint64_t> _push_position;
+	char _pad0[k_cache_line_size - sizeof(std::atomic<uint64_t>)];
+	std::atomic<uint64_t> _pop_position;
+	char _pad1[k_cache_line_size - sizeof(std::atomic<uint64_t>)];
 
-	std::atomic_int _count;
+	ga_queue_slot_t* _slots;
+	uint64_t _mask;
 
-	ga_queue_node_t* _nodes;
+	char* _allocation;
 };
 
-static const uint32_t k_ga_queue_invalid_index = 0xffffffff;
-
-static uint32_t _alloc_node_index(ga_queue_impl_t* impl);
-static void _free_node_index(ga_queue_impl_t* impl, uint32_t index);
-static ga_queue_node_t* _init_node(ga_queue_impl_t* impl, uint32_t node_index);
-
-ga_queue::ga_queue(int node_count)
+ga_queue::ga_queue(int capacity)
 {
 	auto impl = new ga_queue_impl_t;
 
-	impl->_count = 0;
-	impl->_free_list._entire = 0;
-	impl->_nodes = new ga_queue_node_t[node_count];
-
-	/* Link nodes together. */
-	for (int i = 0; i < node_count - 1; ++i)
+	/* Round up to a power of two so positions wrap with a mask. */
+	uint64_t size = 2;
+	while (size < (uint64_t)capacity)
 	{
-		impl->_nodes[i]._next._part._index = i + 1;
-		impl->_nodes[i]._next._part._count = 0;
+		size <<= 1;
 	}
-	impl->_nodes[node_count - 1]._next._part._index = k_ga_queue_invalid_index;
-	impl->_nodes[node_count - 1]._next._part._count = 0;
 
-	/* Populate the queue with a dummy node. */
-	uint32_t dummy_index = _alloc_node_index(impl);
-	_init_node(impl, dummy_index);
+	/* Line the slots up with cache lines. */
+	impl->_allocation = new char[size * sizeof(ga_queue_slot_t) + k_cache_line_size];
+	uintptr_t aligned = ((uintptr_t)impl->_allocation + k_cache_line_size - 1) & ~(uintptr_t)(k_cache_line_size - 1);
+	impl->_slots = reinterpret_cast<ga_queue_slot_t*>(aligned);
+
+	for (uint64_t i = 0; i < size; ++i)
+	{
+		ga_queue_slot_t* slot = new (impl->_slots + i) ga_queue_slot_t;
+		slot->_sequence.store(i, std::memory_order_relaxed);
+		slot->_data = 0;
+	}
 
-	impl->_head._part._index = dummy_index;
-	impl->_head._part._count = 0;
-	impl->_tail._part._index = dummy_index;
-	impl->_tail._part._count = 0;
+	impl->_mask = size - 1;
+	impl->_push_position.store(0, std::memory_order_relaxed);
+	impl->_pop_position.store(0, std::memory_order_relaxed);
 
 	_impl = impl;
 }
@@ -85,172 +76,144 @@ ga_queue::ga_queue(int node_count)
 ga_queue::~ga_queue()
 {
 	ga_queue_impl_t* impl = static_cast<ga_queue_impl_t*>(_impl);
-	delete[] impl->_nodes;
+	delete[] impl->_allocation;
 	delete impl;
 }
 
-void ga_queue::push(void* data)
+bool ga_queue::push(void* data)
 {
 	ga_queue_impl_t* impl = static_cast<ga_queue_impl_t*>(_impl);
 
-	/* Allocate a new node for this data. */
-	uint32_t node_index = _alloc_node_index(impl);
-	ga_queue_node_t* node = _init_node(impl, node_index);
-	node->_data = data;
-
-	ga_queue_pointer_t tail;
-
-	/* Try until the push succeeds. */
+	uint64_t position = impl->_push_position.load(std::memory_order_relaxed);
 	for (;;)
 	{
-		tail = impl->_tail;
-		ga_queue_pointer_t next = impl->_nodes[tail._part._index]._next;
+		ga_queue_slot_t* slot = impl->_slots + (position & impl->_mask);
+		uint64_t sequence = slot->_sequence.load(std::memory_order_acquire);
+		int64_t difference = (int64_t)(sequence - position);
 
-		/* Is our view of the queue still consistent? If not, try again. */
-		if (tail._entire == impl->_tail._entire)
+		if (difference == 0)
 		{
-			/* Is tail pointing to last node? */
-			if (next._part._index == k_ga_queue_invalid_index)
+			/* The slot is free. Claim the position, or learn who beat us to it. */
+			if (impl->_push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
 			{
-				/* Attempt to push new node onto tail. Leave the loop on success. */
-				ga_queue_pointer_t link;
-				link._part._index = node_index;
-				link._part._count = next._part._count + 1;
-				if (impl->_nodes[tail._part._index]._next._atomic.compare_exchange_strong(next._entire, link._entire))
-				{
-					break;
-				}
-			}
-
-			/* Tail has fallen behind the actual end of the queue. Fix that. */
-			else
-			{
-				ga_queue_pointer_t link;
-				link._part._index = next._part._index;
-				link._part._count = tail._part._count + 1;
-				impl->_tail._atomic.compare_exchange_strong(tail._entire, link._entire);
+				slot->_data = data;
+				slot->_sequence.store(position + 1, std::memory_order_release);
+				return true;
 			}
 		}
-	}
-
-	/* Try to advance the tail pointer. We'll handle the fail case on future calls. */
-	{
-		ga_queue_pointer_t link;
-		link._part._index = node_index;
-		link._part._count = tail._part._count + 1;
-		impl->_tail._atomic.compare_exchange_strong(tail._entire, link._entire);
-		impl->_count++;
+		else if (difference < 0)
+		{
+			/* The slot still holds data from a lap ago, so the queue is full. */
+			return false;
+		}
+		else
+		{
+			/* Another producer took this position. */
+			position = impl->_push_position.load(std::memory_order_relaxed);
+		}
 	}
 }
 
-bool ga_queue::pop(void** data)
+int ga_queue::push_batch(void* const* data, int count)
 {
 	ga_queue_impl_t* impl = static_cast<ga_queue_impl_t*>(_impl);
-	ga_queue_pointer_t head;
+	uint64_t capacity = impl->_mask + 1;
+	if (count <= 0)
+	{
+		return 0;
+	}
 
+	/*
+	** A stale pop position only makes the queue look fuller than it is, so
+	** whatever we claim really is free, or about to be.
+	*/
+	uint64_t position = impl->_push_position.load(std::memory_order_relaxed);
+	uint64_t claimed;
 	for (;;)
 	{
-		head = impl->_head;
-		ga_queue_pointer_t tail = impl->_tail;
-		ga_queue_pointer_t next = impl->_nodes[head._part._index]._next;
+		int64_t used = (int64_t)(position - impl->_pop_position.load(std::memory_order_acquire));
+		if (used < 0)
+		{
+			/* Our push position is older than the pops. */
+			position = impl->_push_position.load(std::memory_order_relaxed);
+			continue;
+		}
 
-		/* Is our view of the queue still consistent? If not, try again. */
-		if (head._entire == impl->_head._entire)
+		uint64_t room = (uint64_t)used < capacity ? capacity - (uint64_t)used : 0;
+		claimed = (uint64_t)count < room ? (uint64_t)count : room;
+		if (claimed == 0)
 		{
-			if (head._part._index == tail._part._index)
-			{
-				/* If queue is empty, fail the pop. */
-				if (next._part._index == k_ga_queue_invalid_index)
-				{
-					return false;
-				}
+			return 0;
+		}
+		if (impl->_push_position.compare_exchange_weak(position, position + claimed, std::memory_order_relaxed))
+		{
+			break;
+		}
+	}
 
-				/* Tail has fallen behind the actual end of the queue. Fix that. */
-				ga_queue_pointer_t link;
-				link._part._index = next._part._index;
-				link._part._count = tail._part._count + 1;
-				impl->_tail._atomic.compare_exchange_strong(tail._entire, link._entire);
-			}
-			else
-			{
-				/* Grab the data. */
-				*data = impl->_nodes[next._part._index]._data;
+	for (uint64_t i = 0; i < claimed; ++i)
+	{
+		ga_queue_slot_t* slot = impl->_slots + ((position + i) & impl->_mask);
 
-				/* Attempt to pop the node. Leave the loop on success. */
-				ga_queue_pointer_t link;
-				link._part._index = next._part._index;
-				link._part._count = head._part._count + 1;
-				if (impl->_head._atomic.compare_exchange_strong(head._entire, link._entire))
-				{
-					break;
-				}
-			}
+		/* A pop may still be finishing with the slot from the last lap. */
+		while (slot->_sequence.load(std::memory_order_acquire) != position + i)
+		{
+			std::this_thread::yield();
 		}
+
+		slot->_data = data[i];
+		slot->_sequence.store(position + i + 1, std::memory_order_release);
 	}
 
-	impl->_count--;
-	_free_node_index(impl, head._part._index);
-	return true;
+	return (int)claimed;
 }
 
-int ga_queue::get_count() const
+bool ga_queue::pop(void** data)
 {
 	ga_queue_impl_t* impl = static_cast<ga_queue_impl_t*>(_impl);
-	return impl->_count;
-}
-
-static uint32_t _alloc_node_index(ga_queue_impl_t* impl)
-{
-	uint32_t index;
 
+	uint64_t position = impl->_pop_position.load(std::memory_order_relaxed);
 	for (;;)
 	{
-		ga_queue_pointer_t free_list = impl->_free_list;
+		ga_queue_slot_t* slot = impl->_slots + (position & impl->_mask);
+		uint64_t sequence = slot->_sequence.load(std::memory_order_acquire);
+		int64_t difference = (int64_t)(sequence - (position + 1));
 
-		if (free_list._part._index != k_ga_queue_invalid_index)
+		if (difference == 0)
 		{
-			index = free_list._part._index;
-			ga_queue_pointer_t next = impl->_nodes[index]._next;
-
-			ga_queue_pointer_t link;
-			link._part._index = next._part._index;
-			link._part._count = free_list._part._count + 1;
-			if (impl->_free_list._atomic.compare_exchange_strong(free_list._entire, link._entire))
+			if (impl->_pop_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
 			{
-				break;
+				*data = slot->_data;
+
+				/* Hand the slot to the push one lap ahead. */
+				slot->_sequence.store(position + impl->_mask + 1, std::memory_order_release);
+				return true;
 			}
 		}
-	}
-
-	return index;
-}
-
-static void _free_node_index(ga_queue_impl_t* impl, uint32_t index)
-{
-	ga_queue_node_t* node = impl->_nodes + index;
-	for (;;)
-	{
-		ga_queue_pointer_t free_list = impl->_free_list;
-		node->_next._part._index = free_list._part._index;
-
-		ga_queue_pointer_t link;
-		link._part._index = index;
-		link._part._count = free_list._part._count + 1;
-		if (impl->_free_list._atomic.compare_exchange_strong(free_list._entire, link._entire))
+		else if (difference < 0)
 		{
-			break;
+			/* Nothing has been pushed at this position yet, so the queue is empty. */
+			return false;
+		}
+		else
+		{
+			position = impl->_pop_position.load(std::memory_order_relaxed);
 		}
 	}
 }
 
-static ga_queue_node_t* _init_node(ga_queue_impl_t* impl, uint32_t node_index)
+int ga_queue::get_count() const
 {
-	ga_queue_node_t* node = impl->_nodes + node_index;
-	node->_data = 0;
-	node->_next._part._index = k_ga_queue_invalid_index;
-	node->_next._part._count = 0;
+	ga_queue_impl_t* impl = static_cast<ga_queue_impl_t*>(_impl);
 
-	std::atomic_thread_fence(std::memory_order_release);
+	/* Only a snapshot while other threads are pushing or popping. */
+	uint64_t pop_position = impl->_pop_position.load(std::memory_order_relaxed);
+	uint64_t push_position = impl->_push_position.load(std::memory_order_relaxed);
+	return push_position > pop_position ? (int)(push_position - pop_position) : 0;
+}
 
-	return node;
+int ga_queue::get_capacity() const
+{
+	ga_queue_impl_t* impl = static_cast<ga_queue_impl_t*>(_impl);
+	return (int)(impl->_mask + 1);
 }
@@ -10,20 +10,38 @@
 */
 
 /*
-** Thread-safe, lock-free queue.
-** https://www.research.ibm.com/people/m/michael/podc-1996.pdf
+** Thread-safe, lock-free, bounded queue.
+** Any number of threads may push and pop. Each operation is a single CAS on
+** the position it claims, and slots sit on their own cache lines.
+** http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
 */
 class ga_queue
 {
 public:
-	ga_queue(int node_count);
+	/* Capacity is rounded up to a power of two. */
+	ga_queue(int capacity);
 	~ga_queue();
 
-	void push(void* data);
+	/*
+	** Fails if the queue is full. A pop that is still finishing with the
+	** oldest entry counts as holding it, so a push can briefly fail even
+	** when there is room.
+	*/
+	bool push(void* data);
 	bool pop(void** data);
 
+	/*
+	** Claims room for as many as fit with a single CAS, then fills the slots.
+	** Returns how many were pushed.
+	*/
+	int push_batch(void* const* data, int count);
+
 	int get_count() const;
+	int get_capacity() const;
 
 private:
+	ga_queue(const ga_queue&) = delete;
+	ga_queue& operator=(const ga_queue&) = delete;
+
 	void* _impl;
 };
@@ -0,0 +1,157 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "ga_semaphore.h"
+
+#include "framework/ga_compiler_defines.h"
+
+#include <atomic>
+#include <cstdint>
+
+#if defined(GA_LINUX)
+
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static void _ga_semaphore_sleep(std::atomic<int32_t>* address, int32_t value)
+{
+	syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, value, 0, 0, 0);
+}
+
+static void _ga_semaphore_wake(std::atomic<int32_t>* address, int count)
+{
+	syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count, 0, 0, 0);
+}
+
+#elif defined(GA_MSVC)
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+
+#pragma comment(lib, "Synchronization.lib")
+
+static void _ga_semaphore_sleep(std::atomic<int32_t>* address, int32_t value)
+{
+	WaitOnAddress(address, &value, sizeof(value), INFINITE);
+}
+
+static void _ga_semaphore_wake(std::atomic<int32_t>* address, int count)
+{
+	if (count == 1)
+	{
+		WakeByAddressSingle(address);
+	}
+	else
+	{
+		WakeByAddressAll(address);
+	}
+}
+
+#else
+
+/*
+** No address wait on this platform, so park on a condition variable.
+*/
+#include <condition_variable>
+#include <mutex>
+
+#define GA_SEMAPHORE_CONDVAR
+
+#endif
+
+struct ga_semaphore_impl_t
+{
+	std::atomic<int32_t> _count;
+
+	/* Threads asleep or about to sleep, so signal can skip the wake when there are none. */
+	std::atomic<int32_t> _sleeper_count;
+
+#if defined(GA_SEMAPHORE_CONDVAR)
+	std::mutex _mutex;
+	std::condition_variable _condvar;
+#endif
+};
+
+ga_semaphore::ga_semaphore(int count)
+{
+	auto impl = new ga_semaphore_impl_t;
+	impl->_count = count;
+	impl->_sleeper_count = 0;
+	_impl = impl;
+}
+
+ga_semaphore::~ga_semaphore()
+{
+	delete static_cast<ga_semaphore_impl_t*>(_impl);
+}
+
+void ga_semaphore::wait()
+{
+	ga_semaphore_impl_t* impl = static_cast<ga_semaphore_impl_t*>(_impl);
+
+	int32_t count = impl->_count.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		if (count > 0)
+		{
+			if (impl->_count.compare_exchange_weak(count, count - 1, std::memory_order_acquire, std::memory_order_relaxed))
+			{
+				return;
+			}
+			continue;
+		}
+
+		/*
+		** Announce ourselves before sleeping. The sleep only happens if the
+		** count is still zero, so a signal in between isn't lost.
+		*/
+		impl->_sleeper_count.fetch_add(1, std::memory_order_seq_cst);
+#if defined(GA_SEMAPHORE_CONDVAR)
+		{
+			std::unique_lock<std::mutex> lock(impl->_mutex);
+			impl->_condvar.wait(lock, [impl] { return impl->_count.load(std::memory_order_seq_cst) > 0; });
+		}
+#else
+		_ga_semaphore_sleep(&impl->_count, 0);
+#endif
+		impl->_sleeper_count.fetch_sub(1, std::memory_order_relaxed);
+
+		count = impl->_count.load(std::memory_order_relaxed);
+	}
+}
+
+void ga_semaphore::signal(int count)
+{
+	ga_semaphore_impl_t* impl = static_cast<ga_semaphore_impl_t*>(_impl);
+
+	impl->_count.fetch_add(count, std::memory_order_seq_cst);
+	if (impl->_sleeper_count.load(std::memory_order_seq_cst) == 0)
+	{
+		return;
+	}
+
+#if defined(GA_SEMAPHORE_CONDVAR)
+	{
+		std::lock_guard<std::mutex> lock(impl->_mutex);
+	}
+	if (count == 1)
+	{
+		impl->_condvar.notify_one();
+	}
+	else
+	{
+		impl->_condvar.notify_all();
+	}
+#else
+	_ga_semaphore_wake(&impl->_count, count);
+#endif
+}
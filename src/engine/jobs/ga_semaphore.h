@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+/*
+** Counting semaphore.
+** The count lives in user space, so signaling costs a system call only when
+** a thread is actually asleep on it. Sleeping uses a futex on Linux and
+** WaitOnAddress on Windows.
+*/
+class ga_semaphore
+{
+public:
+	ga_semaphore(int count = 0);
+	~ga_semaphore();
+
+	/* Takes one from the count, sleeping until there is one to take. */
+	void wait();
+
+	void signal(int count = 1);
+
+private:
+	ga_semaphore(const ga_semaphore&) = delete;
+	ga_semaphore& operator=(const ga_semaphore&) = delete;
+
+	void* _impl;
+};
@@ -9,16 +9,20 @@
 
 #include "framework/ga_camera.h"
 #include "framework/ga_compiler_defines.h"
+#include "framework/ga_frame_allocator.h"
+#include "framework/ga_frame_graph.h"
 #include "framework/ga_input.h"
 #include "framework/ga_sim.h"
 #include "framework/ga_output.h"
 #include "jobs/ga_job.h"
+#include "jobs/ga_job_trace.h"
 
 #include "entity/ga_entity.h"
 
 #include "graphics/ga_cube_component.h"
 #include "graphics/ga_program.h"
 
+#include "physics/ga_cloth_cache.h"
 #include "physics/ga_cloth_component.h"
 #include "graphics/ga_material.h"
 #include "entity/ga_lua_component.h"
@@ -40,12 +44,26 @@ ga_font* g_font = nullptr;
 
 static void set_root_path(const char* exepath);
 
+// Stages of the frame that run as jobs.
+static void camera_stage(void* data, ga_frame_params* params);
+static void entity_stage(void* data, ga_frame_params* params);
+static void fps_label_stage(void* data, ga_frame_params* params);
+static void cloth_label_stage(void* data, ga_frame_params* params);
+
 
 int main(int argc, const char** argv)
 {
 	set_root_path(argv[0]);
 
-	ga_job::startup(0xffff, 256, 256);
+	// Leave the first hardware thread to the main thread, which runs jobs while it waits.
+	ga_cpu_set worker_cpus = ga_cpu_set::all();
+	worker_cpus.clear(0);
+	ga_job::startup(worker_cpus, 256, 256);
+
+#if defined(GA_JOB_TRACE)
+	// Keep the last few frames of job activity, written out on exit.
+	ga_job_trace::start(64 * 1024);
+#endif
 
 	// Create objects for three phases of the frame: input, sim and output.
 	ga_input* input = new ga_input();
@@ -88,8 +106,10 @@ int main(int argc, const char** argv)
 	cloth_comp.set_particle_fixed_ent(0, 0, &lua, { -1.0f, 1.0f, 1.1f });
 	cloth_comp.set_particle_fixed_ent(5, 0, &lua, { 1.0f, 1.0f, 1.1f });
 
+	// long range attachments keep the cape from over-stretching, so two iterations are enough
 	cloth_comp.set_integration_type(Velocity_verlet);
-	cloth_comp.set_num_iterations(5);
+	cloth_comp.set_long_range_attachments(true);
+	cloth_comp.set_num_iterations(2);
 
 	sim->add_entity(&cape_ent);
 	*/
@@ -154,6 +174,7 @@ int main(int argc, const char** argv)
 
 	cloth_comp.set_num_iterations(3);
 	cloth_comp.set_integration_type(RK4_parallel);
+	cloth_comp.set_compact_vertices(true);
 
 	sim->add_entity(&cloth_ent);
 	*/
@@ -206,54 +227,117 @@ int main(int argc, const char** argv)
 	cloth_comp.set_particle_fixed(0, 9);
 
 	cloth_comp.set_integration_type(RK4_serial);
+	cloth_comp.set_long_range_attachments(true);
 	cloth_comp.set_num_iterations(1);
 
 	sim->add_entity(&flag_ent);
 	*/
 
+	///////////////////////////////////////////////
+	// BAKED FLAG - baked once, then played back with no solver cost
+	///////////////////////////////////////////////
+	/*
+	ga_entity baked_flag_ent;
+	ga_cloth_component baked_flag = ga_cloth_component(&baked_flag_ent, 1, 0.3, 0.3, 15, 15, { -7.5f,5.0f,-5.0f },
+	{ 10.0f,5.0f,-5.0f }, { -7.50f,-5.0f,-5.0f }, { 10.0f,-5.0f,-5.0f }, 0.5f);
+
+	ga_phong_color_material* baked_flag_material = new ga_phong_color_material();
+	baked_flag_material->init();
+	baked_flag_material->set_light_info({ -2.0f, 2, 2.0f }, { 1, 1, 1 }, { 1, 1, 1 }, { 1, 1, 1 });
+	baked_flag_material->set_material_info({ 0.1f, 0.1f, 0.75f }, { 0.5f, 0.5f, 0.5f }, { 0, 0, 0 }, 0.2f);
+	baked_flag_material->set_back_material_info({ 0.1f, 0.1f, 0.3f }, { 0.3f, 0.3f, 0.3f }, { 0, 0, 0 }, 0.2f);
+
+	baked_flag.set_material(baked_flag_material);
+
+	baked_flag.set_particle_fixed(0, 0);
+	baked_flag.set_particle_fixed(0, 14);
+
+	// bake 4 seconds at 60hz the first time, blending the last half second back into the start
+	ga_cloth_cache flag_cache;
+	if (!flag_cache.open("data/flag.gacc"))
+	{
+		baked_flag.bake(&flag_cache, 1.0f / 60.0f, 240, 30);
+		flag_cache.write("data/flag.gacc");
+		flag_cache.open("data/flag.gacc");
+	}
+	baked_flag.set_playback_cache(&flag_cache);
+
+	sim->add_entity(&baked_flag_ent);
+	*/
+
 	/////// END CLOTHES /////////////////
 
 
 	// Create the default font:
 	g_font = new ga_font("VeraMono.ttf", 16.0f, 512, 512);
 
-	// Main loop:
+	// Everything between input and output runs as jobs, ordered only by the
+	// frame data each stage reads and writes. The camera and the fps label
+	// only need input, so they overlap the entity updates; the cloth labels
+	// show constants the cloth updates, so they follow them.
+	ga_frame_graph frame_graph;
+	frame_graph.add_stage("camera", camera_stage, camera,
+		k_frame_resource_input,
+		k_frame_resource_view);
+	frame_graph.add_stage("entities", entity_stage, sim,
+		k_frame_resource_input,
+		k_frame_resource_entities | k_frame_resource_static_drawcalls | k_frame_resource_dynamic_drawcalls,
+		k_job_priority_high);
+	frame_graph.add_stage("fps label", fps_label_stage, nullptr,
+		k_frame_resource_input,
+		k_frame_resource_gui_drawcalls);
+	frame_graph.add_stage("cloth labels", cloth_label_stage, &cloth_comp,
+		k_frame_resource_entities,
+		k_frame_resource_gui_drawcalls);
+
+	// Main loop.
+	// Frames are pipelined over two params objects: while the job system
+	// runs the frame graph for frame N+1 into one, the main thread draws the
+	// snapshot of frame N from the other. Everything output needs is copied
+	// into the drawcalls, so the two never touch the same data. Input and
+	// output stay on the main thread, which owns the window and GL context.
+	ga_frame_params* render_params = nullptr;
+
+	// Each params object gets the frame allocator the frame before last used,
+	// which has been drawn and is done with.
+	ga_frame_allocator frame_allocators[2];
+	uint32_t frame_index = 0;
+
 	while (true)
 	{
+		ga_frame_allocator* frame_allocator = &frame_allocators[frame_index++ & 1];
+		frame_allocator->reset();
+
 		// We pass frame state through the 3 phases using a params object.
-		ga_frame_params params;
+		ga_frame_params* sim_params = new ga_frame_params(frame_allocator);
 
 		// Gather user input and current time.
-		if (!input->update(&params))
+		if (!input->update(sim_params))
 		{
+			delete sim_params;
 			break;
 		}
 
-		// Update the camera.
-		camera->update(&params);
-
-		// Run gameplay.
-		sim->update(&params);
-
-		// Perform the late update.
-		sim->late_update(&params);
-
-		//gui
-		float cloth_structural = cloth_comp.get_k_structural();
-		ga_label(("structural: " + std::to_string(cloth_structural)).c_str(), 20.0f, 35.0f, &params);
+		// Kick off the rest of this frame.
+		ga_job_counter_t frame_counter;
+		frame_graph.run(sim_params, &frame_counter);
 
-		float cloth_sheer = cloth_comp.get_k_sheer();
-		ga_label(("sheer: " + std::to_string(cloth_sheer)).c_str(), 20.0f, 50.0f, &params);
-
-		float cloth_bend = cloth_comp.get_k_bend();
-		ga_label(("bend: " + std::to_string(cloth_bend)).c_str(), 20.0f, 65.0f, &params);
-
-		float fps = 1.0f / std::chrono::duration_cast<std::chrono::duration<float>>(params._delta_time).count();
-		ga_label(("fps: " + std::to_string(fps)).c_str(), 20.0f, 20.0f, &params);
+		// Draw the previous frame to screen while this one runs.
+		if (render_params)
+		{
+			output->update(render_params);
+			delete render_params;
+		}
 
-		// Draw to screen.
-		output->update(&params);
+		ga_job::wait(&frame_counter);
+		render_params = sim_params;
 	}
+	delete render_params;
+
+#if defined(GA_JOB_TRACE)
+	ga_job_trace::stop();
+	ga_job_trace::write_chrome_json("job_trace.json");
+#endif
 
 	delete output;
 	delete sim;
@@ -265,6 +349,37 @@ int main(int argc, const char** argv)
 	return 0;
 }
 
+static void camera_stage(void* data, ga_frame_params* params)
+{
+	static_cast<ga_camera*>(data)->update(params);
+}
+
+static void entity_stage(void* data, ga_frame_params* params)
+{
+	// Run gameplay, with each entity's late update following its own update.
+	static_cast<ga_sim*>(data)->update_overlapped(params);
+}
+
+static void fps_label_stage(void* data, ga_frame_params* params)
+{
+	float fps = 1.0f / std::chrono::duration_cast<std::chrono::duration<float>>(params->_delta_time).count();
+	ga_label(("fps: " + std::to_string(fps)).c_str(), 20.0f, 20.0f, params);
+}
+
+static void cloth_label_stage(void* data, ga_frame_params* params)
+{
+	ga_cloth_component* cloth = static_cast<ga_cloth_component*>(data);
+
+	float cloth_structural = cloth->get_k_structural();
+	ga_label(("structural: " + std::to_string(cloth_structural)).c_str(), 20.0f, 35.0f, params);
+
+	float cloth_sheer = cloth->get_k_sheer();
+	ga_label(("sheer: " + std::to_string(cloth_sheer)).c_str(), 20.0f, 50.0f, params);
+
+	float cloth_bend = cloth->get_k_bend();
+	ga_label(("bend: " + std::to_string(cloth_bend)).c_str(), 20.0f, 65.0f, params);
+}
+
 char g_root_path[256];
 static void set_root_path(const char* exepath)
 {
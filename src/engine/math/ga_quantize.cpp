@@ -0,0 +1,222 @@
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "math/ga_quantize.h"
+
+#include "framework/ga_compiler_defines.h"
+
+#if defined(GA_SSE2)
+#include <emmintrin.h>
+#endif
+
+static const float k_unorm16_max = 65535.0f;
+static const float k_snorm16_max = 32767.0f;
+
+static uint16_t quantize_unorm16(float value, float min, float inv_extent)
+{
+	float q = (value - min) * inv_extent + 0.5f;
+	return (uint16_t)ga_min(ga_max(q, 0.0f), k_unorm16_max);
+}
+
+static int16_t quantize_snorm16(float value)
+{
+	float q = ga_min(ga_max(value, -1.0f), 1.0f) * k_snorm16_max;
+	return (int16_t)(q >= 0.0f ? q + 0.5f : q - 0.5f);
+}
+
+void ga_compute_bounds(const ga_vec3f* points, int count, ga_vec3f& min, ga_vec3f& max)
+{
+	if (count <= 0)
+	{
+		min = ga_vec3f::zero_vector();
+		max = ga_vec3f::zero_vector();
+		return;
+	}
+
+	min = points[0];
+	max = points[0];
+
+	int i = 0;
+
+#if defined(GA_SSE2)
+	/* Four points are three registers, each lane holding a different axis. */
+	if (count >= 4)
+	{
+		const float* f = points[0].axes;
+		__m128 min0 = _mm_loadu_ps(f), max0 = min0;
+		__m128 min1 = _mm_loadu_ps(f + 4), max1 = min1;
+		__m128 min2 = _mm_loadu_ps(f + 8), max2 = min2;
+
+		for (i = 4; i + 4 <= count; i += 4)
+		{
+			const float* p = points[i].axes;
+			__m128 v0 = _mm_loadu_ps(p);
+			__m128 v1 = _mm_loadu_ps(p + 4);
+			__m128 v2 = _mm_loadu_ps(p + 8);
+			min0 = _mm_min_ps(min0, v0); max0 = _mm_max_ps(max0, v0);
+			min1 = _mm_min_ps(min1, v1); max1 = _mm_max_ps(max1, v1);
+			min2 = _mm_min_ps(min2, v2); max2 = _mm_max_ps(max2, v2);
+		}
+
+		/* Lanes are (x y z x) (y z x y) (z x y z). */
+		float lo[12], hi[12];
+		_mm_storeu_ps(lo, min0); _mm_storeu_ps(lo + 4, min1); _mm_storeu_ps(lo + 8, min2);
+		_mm_storeu_ps(hi, max0); _mm_storeu_ps(hi + 4, max1); _mm_storeu_ps(hi + 8, max2);
+		for (int l = 0; l < 12; ++l)
+		{
+			min.axes[l % 3] = ga_min(min.axes[l % 3], lo[l]);
+			max.axes[l % 3] = ga_max(max.axes[l % 3], hi[l]);
+		}
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		for (int a = 0; a < 3; ++a)
+		{
+			min.axes[a] = ga_min(min.axes[a], points[i].axes[a]);
+			max.axes[a] = ga_max(max.axes[a], points[i].axes[a]);
+		}
+	}
+}
+
+void ga_quantize_positions(const ga_vec3f* points, int count, const ga_vec3f& min, const ga_vec3f& max, uint16_t* out)
+{
+	float inv_extent[3];
+	for (int a = 0; a < 3; ++a)
+	{
+		float extent = max.axes[a] - min.axes[a];
+		inv_extent[a] = extent > 0.0f ? k_unorm16_max / extent : 0.0f;
+	}
+
+	int i = 0;
+
+#if defined(GA_SSE2)
+	/* Process four points (twelve floats) per iteration. */
+	const __m128 offset0 = _mm_setr_ps(min.x, min.y, min.z, min.x);
+	const __m128 offset1 = _mm_setr_ps(min.y, min.z, min.x, min.y);
+	const __m128 offset2 = _mm_setr_ps(min.z, min.x, min.y, min.z);
+	const __m128 scale0 = _mm_setr_ps(inv_extent[0], inv_extent[1], inv_extent[2], inv_extent[0]);
+	const __m128 scale1 = _mm_setr_ps(inv_extent[1], inv_extent[2], inv_extent[0], inv_extent[1]);
+	const __m128 scale2 = _mm_setr_ps(inv_extent[2], inv_extent[0], inv_extent[1], inv_extent[2]);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 top = _mm_set1_ps(k_unorm16_max);
+	const __m128i bias32 = _mm_set1_epi32(32768);
+	const __m128i bias16 = _mm_set1_epi16((short)0x8000);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const float* p = points[i].axes;
+		__m128 q0 = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p), offset0), scale0), half);
+		__m128 q1 = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + 4), offset1), scale1), half);
+		__m128 q2 = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(p + 8), offset2), scale2), half);
+
+		q0 = _mm_min_ps(_mm_max_ps(q0, zero), top);
+		q1 = _mm_min_ps(_mm_max_ps(q1, zero), top);
+		q2 = _mm_min_ps(_mm_max_ps(q2, zero), top);
+
+		/* SSE2 only has a signed pack, so bias into signed range and flip back. */
+		__m128i i0 = _mm_sub_epi32(_mm_cvttps_epi32(q0), bias32);
+		__m128i i1 = _mm_sub_epi32(_mm_cvttps_epi32(q1), bias32);
+		__m128i i2 = _mm_sub_epi32(_mm_cvttps_epi32(q2), bias32);
+
+		__m128i packed01 = _mm_xor_si128(_mm_packs_epi32(i0, i1), bias16);
+		__m128i packed2 = _mm_xor_si128(_mm_packs_epi32(i2, i2), bias16);
+
+		_mm_storeu_si128((__m128i*)(out + i * 3), packed01);
+		_mm_storel_epi64((__m128i*)(out + i * 3 + 8), packed2);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		for (int a = 0; a < 3; ++a)
+		{
+			out[i * 3 + a] = quantize_unorm16(points[i].axes[a], min.axes[a], inv_extent[a]);
+		}
+	}
+}
+
+void ga_encode_octahedral(const ga_vec3f* normals, int count, int16_t* out)
+{
+	int i = 0;
+
+#if defined(GA_SSE2)
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 sign_mask = _mm_set1_ps(-0.0f);
+	const __m128 snorm = _mm_set1_ps(k_snorm16_max);
+	const __m128 half = _mm_set1_ps(0.5f);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		const float* n = normals[i].axes;
+		__m128 x = _mm_setr_ps(n[0], n[3], n[6], n[9]);
+		__m128 y = _mm_setr_ps(n[1], n[4], n[7], n[10]);
+		__m128 z = _mm_setr_ps(n[2], n[5], n[8], n[11]);
+
+		/* Project onto the octahedron. */
+		__m128 abs_sum = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign_mask, x), _mm_andnot_ps(sign_mask, y)), _mm_andnot_ps(sign_mask, z));
+		__m128 inv = _mm_div_ps(one, _mm_max_ps(abs_sum, _mm_set1_ps(1e-20f)));
+		__m128 px = _mm_mul_ps(x, inv);
+		__m128 py = _mm_mul_ps(y, inv);
+
+		/* Fold the lower hemisphere over the diagonals. Zero folds as positive, as below. */
+		__m128 sign_x = _mm_or_ps(one, _mm_and_ps(sign_mask, _mm_cmplt_ps(px, zero)));
+		__m128 sign_y = _mm_or_ps(one, _mm_and_ps(sign_mask, _mm_cmplt_ps(py, zero)));
+		__m128 fold_x = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, py)), sign_x);
+		__m128 fold_y = _mm_mul_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, px)), sign_y);
+		__m128 lower = _mm_cmplt_ps(z, zero);
+		px = _mm_or_ps(_mm_and_ps(lower, fold_x), _mm_andnot_ps(lower, px));
+		py = _mm_or_ps(_mm_and_ps(lower, fold_y), _mm_andnot_ps(lower, py));
+
+		/* Round half away from zero, like quantize_snorm16, rather than to even. */
+		__m128 qx = _mm_mul_ps(px, snorm);
+		__m128 qy = _mm_mul_ps(py, snorm);
+		__m128i ix = _mm_cvttps_epi32(_mm_add_ps(qx, _mm_or_ps(half, _mm_and_ps(sign_mask, qx))));
+		__m128i iy = _mm_cvttps_epi32(_mm_add_ps(qy, _mm_or_ps(half, _mm_and_ps(sign_mask, qy))));
+		__m128i packed = _mm_packs_epi32(_mm_unpacklo_epi32(ix, iy), _mm_unpackhi_epi32(ix, iy));
+
+		_mm_storeu_si128((__m128i*)(out + i * 2), packed);
+	}
+#endif
+
+	for (; i < count; ++i)
+	{
+		const ga_vec3f& n = normals[i];
+		float abs_sum = ga_absf(n.x) + ga_absf(n.y) + ga_absf(n.z);
+		float inv = 1.0f / ga_max(abs_sum, 1e-20f);
+		float px = n.x * inv;
+		float py = n.y * inv;
+		if (n.z < 0.0f)
+		{
+			float fx = (1.0f - ga_absf(py)) * (px >= 0.0f ? 1.0f : -1.0f);
+			float fy = (1.0f - ga_absf(px)) * (py >= 0.0f ? 1.0f : -1.0f);
+			px = fx;
+			py = fy;
+		}
+		out[i * 2 + 0] = quantize_snorm16(px);
+		out[i * 2 + 1] = quantize_snorm16(py);
+	}
+}
+
+ga_vec3f ga_decode_octahedral(const int16_t* in)
+{
+	float px = ga_max(in[0] / k_snorm16_max, -1.0f);
+	float py = ga_max(in[1] / k_snorm16_max, -1.0f);
+
+	ga_vec3f n = { px, py, 1.0f - ga_absf(px) - ga_absf(py) };
+	if (n.z < 0.0f)
+	{
+		n.x = (1.0f - ga_absf(py)) * (px >= 0.0f ? 1.0f : -1.0f);
+		n.y = (1.0f - ga_absf(px)) * (py >= 0.0f ? 1.0f : -1.0f);
+	}
+	return n.normal();
+}
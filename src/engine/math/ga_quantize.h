@@ -0,0 +1,36 @@
+#pragma once
+
+/*
+** RPI Game Architecture Engine
+**
+** Portions adapted from:
+** Viper Engine - Copyright (C) 2016 Velan Studios - All Rights Reserved
+**
+** This file is distributed under the MIT License. See LICENSE.txt.
+*/
+
+#include "math/ga_vec3f.h"
+
+#include <cstdint>
+
+/*
+** Compute the axis aligned bounds of a set of points.
+*/
+void ga_compute_bounds(const ga_vec3f* points, int count, ga_vec3f& min, ga_vec3f& max);
+
+/*
+** Quantize points to three 16 bit unsigned values per point, relative to the
+** given bounds. Decode with min + (value / 65535) * (max - min).
+*/
+void ga_quantize_positions(const ga_vec3f* points, int count, const ga_vec3f& min, const ga_vec3f& max, uint16_t* out);
+
+/*
+** Encode unit vectors as octahedral coordinates in two 16 bit signed values.
+** https://knarkowicz.wordpress.com/2014/04/16/octahedron-normal-vector-encoding/
+*/
+void ga_encode_octahedral(const ga_vec3f* normals, int count, int16_t* out);
+
+/*
+** Decode a single octahedral encoded unit vector.
+*/
+ga_vec3f ga_decode_octahedral(const int16_t* in);
@@ -0,0 +1,423 @@
+#include "ga_cloth_cache.h"
+
+#include "framework/ga_compiler_defines.h"
+#include "math/ga_quantize.h"
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#if defined(GA_MSVC) || defined(GA_MINGW)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/**
+* On-disk layout:
+*   ga_cloth_cache_header_t
+*   uint32_t frame_offsets[frame_count + 1]
+*   frame data, per frame one varint per quantised position axis delta, then
+*   one per octahedral normal component delta
+**/
+struct ga_cloth_cache_header_t
+{
+	char _magic[4];
+	uint32_t _version;
+	uint32_t _nx;
+	uint32_t _ny;
+	uint32_t _frame_count;
+	float _min[3];
+	float _scale[3];
+};
+
+struct ga_cloth_cache_mapping_t
+{
+#if defined(GA_MSVC) || defined(GA_MINGW)
+	HANDLE _file;
+	HANDLE _map;
+#else
+	int _fd;
+#endif
+	const uint8_t* _view;
+	size_t _size;
+};
+
+static const char k_cloth_cache_magic[4] = { 'G', 'A', 'C', 'C' };
+static const uint32_t k_cloth_cache_version = 2;
+static const float k_cloth_cache_quantise_max = 65535.0f;
+
+static std::string full_cache_path(const char* path)
+{
+	extern char g_root_path[256];
+	std::string fullpath = g_root_path;
+	fullpath += path;
+	return fullpath;
+}
+
+static ga_cloth_cache_mapping_t* map_file(const char* path);
+static void unmap_file(ga_cloth_cache_mapping_t* mapping);
+
+ga_cloth_cache::ga_cloth_cache()
+{
+	_nx = 0;
+	_ny = 0;
+	_frame_count = 0;
+	_mapping = 0;
+	_frames = 0;
+	_frame_offsets = 0;
+}
+
+ga_cloth_cache::~ga_cloth_cache()
+{
+	close();
+}
+
+void ga_cloth_cache::begin_bake(uint32_t nx, uint32_t ny)
+{
+	close();
+
+	_nx = nx;
+	_ny = ny;
+	_frame_count = 0;
+	_recorded.clear();
+	_recorded_normals.clear();
+}
+
+void ga_cloth_cache::record_frame(const ga_vec3f* positions, const ga_vec3f* normals)
+{
+	_recorded.insert(_recorded.end(), positions, positions + _nx * _ny);
+	_recorded_normals.insert(_recorded_normals.end(), normals, normals + _nx * _ny);
+	_frame_count++;
+}
+
+/**
+* Blends the tail of the bake into the first frame so playback doesn't pop
+* when it wraps around.
+**/
+void ga_cloth_cache::close_loop(uint32_t blend_frames)
+{
+	uint32_t count = _nx * _ny;
+	if (blend_frames >= _frame_count)
+	{
+		blend_frames = _frame_count > 0 ? _frame_count - 1 : 0;
+	}
+
+	for (uint32_t t = 0; t < blend_frames; t++)
+	{
+		float w = (float)(t + 1) / (float)(blend_frames + 1);
+		ga_vec3f* frame = &_recorded[(_frame_count - blend_frames + t) * count];
+
+		ga_vec3f* normals = &_recorded_normals[(_frame_count - blend_frames + t) * count];
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			frame[i] = frame[i].scale_result(1.0f - w) + _recorded[i].scale_result(w);
+			normals[i] = (normals[i].scale_result(1.0f - w) + _recorded_normals[i].scale_result(w)).normal();
+		}
+	}
+}
+
+/**
+* Helper functions for the delta encoding. Deltas between quantised frames fit
+* in 17 signed bits, which zig-zag encoding folds into an unsigned varint.
+* Normal deltas wrap around in 16 bits like position deltas do.
+**/
+static void write_varint(std::vector<uint8_t>& out, int32_t delta)
+{
+	uint32_t v = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+	while (v >= 0x80)
+	{
+		out.push_back((uint8_t)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((uint8_t)v);
+}
+
+// Fails rather than read past end, or past the five bytes a 32 bit value can take
+static bool read_varint(const uint8_t*& in, const uint8_t* end, int32_t& delta)
+{
+	uint32_t v = 0;
+	uint32_t shift = 0;
+	uint8_t byte;
+	do
+	{
+		if (in == end || shift > 28)
+		{
+			return false;
+		}
+		byte = *in++;
+		v |= (uint32_t)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	delta = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+	return true;
+}
+
+bool ga_cloth_cache::write(const char* path) const
+{
+	uint32_t count = _nx * _ny;
+	if (_frame_count == 0 || count == 0)
+	{
+		return false;
+	}
+
+	// bounds of the entire bake
+	ga_vec3f min, max;
+	ga_compute_bounds(&_recorded[0], (int)_recorded.size(), min, max);
+
+	ga_cloth_cache_header_t header;
+	memcpy(header._magic, k_cloth_cache_magic, sizeof(header._magic));
+	header._version = k_cloth_cache_version;
+	header._nx = _nx;
+	header._ny = _ny;
+	header._frame_count = _frame_count;
+
+	for (int a = 0; a < 3; a++)
+	{
+		header._min[a] = min.axes[a];
+		header._scale[a] = (max.axes[a] - min.axes[a]) / k_cloth_cache_quantise_max;
+	}
+
+	// quantise each frame and store it as deltas against the previous one
+	std::vector<uint32_t> offsets;
+	std::vector<uint8_t> data;
+	std::vector<uint16_t> previous(count * 3, 0);
+	std::vector<uint16_t> quantised(count * 3);
+	std::vector<int16_t> previous_normals(count * 2, 0);
+	std::vector<int16_t> encoded_normals(count * 2);
+
+	for (uint32_t f = 0; f < _frame_count; f++)
+	{
+		offsets.push_back((uint32_t)data.size());
+
+		ga_quantize_positions(&_recorded[f * count], count, min, max, &quantised[0]);
+		for (uint32_t i = 0; i < count * 3; i++)
+		{
+			write_varint(data, (int32_t)quantised[i] - (int32_t)previous[i]);
+			previous[i] = quantised[i];
+		}
+
+		ga_encode_octahedral(&_recorded_normals[f * count], count, &encoded_normals[0]);
+		for (uint32_t i = 0; i < count * 2; i++)
+		{
+			write_varint(data, (int32_t)(int16_t)(encoded_normals[i] - previous_normals[i]));
+			previous_normals[i] = encoded_normals[i];
+		}
+	}
+	offsets.push_back((uint32_t)data.size());
+
+	std::ofstream file(full_cache_path(path), std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cerr << "Failed to open cloth cache for writing: " << path << std::endl;
+		return false;
+	}
+
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)&offsets[0], sizeof(uint32_t) * offsets.size());
+	file.write((const char*)&data[0], data.size());
+
+	return file.good();
+}
+
+bool ga_cloth_cache::open(const char* path)
+{
+	close();
+
+	ga_cloth_cache_mapping_t* mapping = map_file(full_cache_path(path).c_str());
+	if (!mapping)
+	{
+		std::cerr << "Failed to map cloth cache: " << path << std::endl;
+		return false;
+	}
+
+	// the frame offsets must fit in the file, and every frame must lie inside it
+	const ga_cloth_cache_header_t* header = (const ga_cloth_cache_header_t*)mapping->_view;
+	bool valid = mapping->_size >= sizeof(ga_cloth_cache_header_t) &&
+		memcmp(header->_magic, k_cloth_cache_magic, sizeof(header->_magic)) == 0 &&
+		header->_version == k_cloth_cache_version &&
+		header->_nx > 0 && header->_ny > 0 && header->_frame_count > 0 &&
+		header->_frame_count < (mapping->_size - sizeof(ga_cloth_cache_header_t)) / sizeof(uint32_t);
+
+	const uint32_t* offsets = (const uint32_t*)(mapping->_view + sizeof(ga_cloth_cache_header_t));
+	if (valid)
+	{
+		size_t frames_begin = sizeof(ga_cloth_cache_header_t) + sizeof(uint32_t) * ((size_t)header->_frame_count + 1);
+		for (uint32_t f = 0; valid && f < header->_frame_count; f++)
+		{
+			valid = offsets[f] <= offsets[f + 1];
+		}
+		valid = valid && offsets[header->_frame_count] <= mapping->_size - frames_begin;
+	}
+
+	if (!valid)
+	{
+		std::cerr << "Invalid cloth cache: " << path << std::endl;
+		unmap_file(mapping);
+		return false;
+	}
+
+	_nx = header->_nx;
+	_ny = header->_ny;
+	_frame_count = header->_frame_count;
+	_min = { header->_min[0], header->_min[1], header->_min[2] };
+	_extent = { header->_scale[0] * k_cloth_cache_quantise_max, header->_scale[1] * k_cloth_cache_quantise_max,
+		header->_scale[2] * k_cloth_cache_quantise_max };
+
+	_frame_offsets = offsets;
+	_frames = (const uint8_t*)(_frame_offsets + _frame_count + 1);
+	_recorded.clear();
+	_recorded_normals.clear();
+
+	_mapping = mapping;
+	return true;
+}
+
+void ga_cloth_cache::close()
+{
+	if (_mapping)
+	{
+		unmap_file(static_cast<ga_cloth_cache_mapping_t*>(_mapping));
+		_mapping = 0;
+		_frames = 0;
+		_frame_offsets = 0;
+	}
+}
+
+bool ga_cloth_cache::next_frame(ga_cloth_cache_cursor_t* cursor, uint16_t* positions, int16_t* normals) const
+{
+	assert(is_open());
+
+	// the first frame is stored relative to zero, so wrapping just resets the decoder
+	size_t count = (size_t)_nx * _ny;
+	if (cursor->_frame >= _frame_count || cursor->_positions.size() != count * 3)
+	{
+		cursor->_frame = 0;
+	}
+	if (cursor->_frame == 0)
+	{
+		cursor->_positions.assign(count * 3, 0);
+		cursor->_normals.assign(count * 2, 0);
+	}
+
+	const uint8_t* in = _frames + _frame_offsets[cursor->_frame];
+	const uint8_t* end = _frames + _frame_offsets[cursor->_frame + 1];
+	int32_t delta;
+	for (size_t i = 0; i < count * 3; i++)
+	{
+		if (!read_varint(in, end, delta))
+		{
+			cursor->_frame = 0;
+			return false;
+		}
+
+		uint16_t& value = cursor->_positions[i];
+		value = (uint16_t)(value + delta);
+		positions[i] = value;
+	}
+	for (size_t i = 0; i < count * 2; i++)
+	{
+		if (!read_varint(in, end, delta))
+		{
+			cursor->_frame = 0;
+			return false;
+		}
+
+		int16_t& value = cursor->_normals[i];
+		value = (int16_t)(uint16_t)(value + delta);
+		normals[i] = value;
+	}
+
+	cursor->_frame = (cursor->_frame + 1) % _frame_count;
+	return true;
+}
+
+#if defined(GA_MSVC) || defined(GA_MINGW)
+static ga_cloth_cache_mapping_t* map_file(const char* path)
+{
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return 0;
+	}
+
+	LARGE_INTEGER size;
+	HANDLE map = 0;
+	const void* view = 0;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+	{
+		map = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+		if (map)
+		{
+			view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+		}
+	}
+
+	if (!view)
+	{
+		if (map) CloseHandle(map);
+		CloseHandle(file);
+		return 0;
+	}
+
+	ga_cloth_cache_mapping_t* mapping = new ga_cloth_cache_mapping_t;
+	mapping->_file = file;
+	mapping->_map = map;
+	mapping->_view = (const uint8_t*)view;
+	mapping->_size = (size_t)size.QuadPart;
+	return mapping;
+}
+
+static void unmap_file(ga_cloth_cache_mapping_t* mapping)
+{
+	UnmapViewOfFile(mapping->_view);
+	CloseHandle(mapping->_map);
+	CloseHandle(mapping->_file);
+	delete mapping;
+}
+#else
+static ga_cloth_cache_mapping_t* map_file(const char* path)
+{
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		return 0;
+	}
+
+	struct stat st;
+	void* view = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && st.st_size > 0)
+	{
+		view = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+
+	if (view == MAP_FAILED)
+	{
+		::close(fd);
+		return 0;
+	}
+
+	ga_cloth_cache_mapping_t* mapping = new ga_cloth_cache_mapping_t;
+	mapping->_fd = fd;
+	mapping->_view = (const uint8_t*)view;
+	mapping->_size = (size_t)st.st_size;
+	return mapping;
+}
+
+static void unmap_file(ga_cloth_cache_mapping_t* mapping)
+{
+	munmap((void*)mapping->_view, mapping->_size);
+	::close(mapping->_fd);
+	delete mapping;
+}
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "math/ga_vec3f.h"
+
+#include <cstdint>
+#include <vector>
+
+/**
+* One cloth's place in the loop of a baked cache
+**/
+struct ga_cloth_cache_cursor_t
+{
+	ga_cloth_cache_cursor_t() : _frame(0) {}
+
+	// the next frame to decode, and the encoded values of the last one decoded
+	uint32_t _frame;
+	std::vector<uint16_t> _positions;
+	std::vector<int16_t> _normals;
+};
+
+/**
+* Baked cloth animation cache.
+*
+* A bake records particle positions and normals from a ga_cloth_component
+* once per frame and writes them out as 16 bit positions quantised against the
+* bounds of the whole bake, and octahedral encoded normals. Each frame is
+* stored as the difference from the previous one, zig-zag and varint encoded,
+* so slow moving cloth packs down to a byte or two per axis.
+*
+* Playback maps the file into memory and decodes one frame per update straight
+* into compact vertex streams, looping back to the start when the last frame
+* is reached. The cache itself isn't changed by playback, so any number of
+* cloths can share one, each with its own cursor.
+**/
+class ga_cloth_cache
+{
+public:
+	ga_cloth_cache();
+	~ga_cloth_cache();
+
+	/**
+	* Baking
+	**/
+	// Starts a new bake for a cloth with nx * ny particles
+	void begin_bake(uint32_t nx, uint32_t ny);
+
+	// Records one frame of nx * ny particle positions and normals
+	void record_frame(const ga_vec3f* positions, const ga_vec3f* normals);
+
+	// Blends the last blend_frames frames towards the first so the loop is seamless
+	void close_loop(uint32_t blend_frames);
+
+	// Quantises, compresses and writes the recorded frames to disk
+	bool write(const char* path) const;
+
+	/**
+	* Playback
+	**/
+	// Maps a baked file into memory for playback
+	bool open(const char* path);
+	void close();
+
+	// Decodes the cursor's next frame of the loop into nx * ny positions, three
+	// 16 bit values each relative to the position bounds, and nx * ny normals,
+	// two octahedral values each. Returns false if the frame's data is corrupt,
+	// and starts the cursor's loop over.
+	bool next_frame(ga_cloth_cache_cursor_t* cursor, uint16_t* positions, int16_t* normals) const;
+
+	bool is_open() const { return _mapping != 0; }
+	uint32_t get_nx() const { return _nx; }
+	uint32_t get_ny() const { return _ny; }
+	uint32_t get_frame_count() const { return _frame_count; }
+	const ga_vec3f& get_position_min() const { return _min; }
+	const ga_vec3f& get_position_extent() const { return _extent; }
+
+private:
+	uint32_t _nx;
+	uint32_t _ny;
+	uint32_t _frame_count;
+
+	// frames recorded by the current bake
+	std::vector<ga_vec3f> _recorded;
+	std::vector<ga_vec3f> _recorded_normals;
+
+	// memory mapped file used for playback
+	void* _mapping;
+	const uint8_t* _frames;
+	const uint32_t* _frame_offsets;
+	ga_vec3f _min;
+	ga_vec3f _extent;
+};
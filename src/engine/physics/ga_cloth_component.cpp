@@ -1,11 +1,17 @@
 #include "ga_cloth_component.h"
+#include "ga_cloth_cache.h"
 
 #include "entity/ga_entity.h"
 
 #include "graphics/ga_material.h"
+#include "math/ga_quantize.h"
+#include <cfloat>
+#include <functional>
 #include <iostream>
+#include <queue>
 
 #include "jobs/ga_job.h"
+#include "jobs/ga_job_graph.h"
 
 ga_cloth_component::ga_cloth_component(ga_entity* ent, float structural_k, float sheer_k, float bend_k, uint32_t nx, uint32_t ny,
 	ga_vec3f top_left, ga_vec3f top_right, ga_vec3f bot_left, ga_vec3f bot_right, float fabric_weight) : ga_component(ent)
@@ -48,6 +54,12 @@ ga_cloth_component::ga_cloth_component(ga_entity* ent, float structural_k, float
 	_dampening = 0.008f;
 	_num_iterations = 1;
 	_integration_type = RK4_serial;
+	_playback_cache = nullptr;
+	_compact_vertices = false;
+
+	_row_graph = new ga_job_graph();
+	_lra_enabled = false;
+	_lra_dirty = true;
 }
 
 
@@ -109,10 +121,21 @@ ga_vec3f ga_cloth_component::normal_for_point(int i, int j)
 **/
 void ga_cloth_component::update_draw(struct ga_frame_params* params)
 {
-	// vectors to keep track of all values given to drawcall
-	std::vector<ga_vec3f> verts;
-	std::vector<GLushort> indices;
-	std::vector<ga_vec3f> norms;
+	if (_compact_vertices)
+	{
+		update_draw_compact(params);
+		return;
+	}
+
+	// build straight into the drawcall's arrays, which live in frame memory
+	uint32_t quad_count = (_nx - 1) * (_ny - 1);
+	ga_dynamic_drawcall draw(params->_allocator);
+	ga_frame_vector<ga_vec3f>& verts = draw._positions;
+	ga_frame_vector<uint16_t>& indices = draw._indices;
+	ga_frame_vector<ga_vec3f>& norms = draw._normals;
+	verts.reserve(quad_count * 4);
+	indices.reserve(quad_count * 6);
+	norms.reserve(quad_count * 4);
 
 	for (int i = 1; i < _nx; i++)
 	{
@@ -139,22 +162,121 @@ void ga_cloth_component::update_draw(struct ga_frame_params* params)
 		}
 	}
 
-	// create dynamic draw call and send it
-	ga_dynamic_drawcall draw;
+	// send the dynamic draw call
 	draw._name = "ga_cloth_dynamic";
 	draw._color = { 0.0f, 0.5f, 1.0f };
 	draw._material = _material;
-	draw._positions = verts;
-	draw._indices = indices;
 	draw._transform = get_entity()->get_transform();
 	draw._draw_mode = GL_TRIANGLES;
-	draw._normals = norms;
 
-	while (params->_dynamic_drawcall_lock.test_and_set(std::memory_order_acquire)) {}
-	params->_dynamic_drawcalls.push_back(draw);
-	params->_dynamic_drawcall_lock.clear(std::memory_order_release);
+	params->_dynamic_drawcall_lock.lock();
+	params->_dynamic_drawcalls.push_back(std::move(draw));
+	params->_dynamic_drawcall_lock.unlock();
 
 }
+/**
+* Compact version of update_draw. Every particle is sent once and shared by
+* the surrounding quads, with positions quantised against the cloth's bounds
+* and normals octahedral encoded.
+**/
+void ga_cloth_component::update_draw_compact(struct ga_frame_params* params)
+{
+	uint32_t count = _nx * _ny;
+	_draw_positions.resize(count);
+	_draw_normals.resize(count);
+
+	// gather rows in parallel, finding the bounds on the way
+	struct bounds_t
+	{
+		ga_vec3f _min;
+		ga_vec3f _max;
+	};
+	bounds_t empty;
+	empty._min = { FLT_MAX, FLT_MAX, FLT_MAX };
+	empty._max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	bounds_t bounds = ga_job::parallel_reduce(0, int(_ny), 0, empty, [this](int j, bounds_t& b)
+	{
+		for (uint32_t i = 0; i < _nx; i++)
+		{
+			ga_vec3f position = get_particle(i, j).get_position();
+			_draw_positions[i + j*_nx] = position;
+			_draw_normals[i + j*_nx] = normal_for_point(i, j);
+
+			for (int axis = 0; axis < 3; axis++)
+			{
+				b._min.axes[axis] = position.axes[axis] < b._min.axes[axis] ? position.axes[axis] : b._min.axes[axis];
+				b._max.axes[axis] = position.axes[axis] > b._max.axes[axis] ? position.axes[axis] : b._max.axes[axis];
+			}
+		}
+	},
+	[](const bounds_t& a, const bounds_t& b)
+	{
+		bounds_t result;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			result._min.axes[axis] = a._min.axes[axis] < b._min.axes[axis] ? a._min.axes[axis] : b._min.axes[axis];
+			result._max.axes[axis] = a._max.axes[axis] > b._max.axes[axis] ? a._max.axes[axis] : b._max.axes[axis];
+		}
+		return result;
+	});
+
+	ga_dynamic_drawcall draw(params->_allocator);
+	draw._name = "ga_cloth_dynamic";
+	draw._color = { 0.0f, 0.5f, 1.0f };
+	draw._material = _material;
+	draw._transform = get_entity()->get_transform();
+	draw._draw_mode = GL_TRIANGLES;
+
+	ga_vec3f max = bounds._max;
+	draw._position_min = bounds._min;
+	draw._position_extent = max - draw._position_min;
+
+	draw._packed_positions.resize(count * 3);
+	ga_quantize_positions(&_draw_positions[0], count, draw._position_min, max, &draw._packed_positions[0]);
+
+	draw._packed_normals.resize(count * 2);
+	ga_encode_octahedral(&_draw_normals[0], count, &draw._packed_normals[0]);
+
+	build_compact_indices();
+	draw._indices.assign(_compact_indices.begin(), _compact_indices.end());
+
+	params->_dynamic_drawcall_lock.lock();
+	params->_dynamic_drawcalls.push_back(std::move(draw));
+	params->_dynamic_drawcall_lock.unlock();
+}
+
+/**
+* Compact vertices are one per particle, so the triangles over them never
+* change and are only built once
+**/
+void ga_cloth_component::build_compact_indices()
+{
+	if (!_compact_indices.empty())
+	{
+		return;
+	}
+
+	_compact_indices.reserve((_nx - 1) * (_ny - 1) * 6);
+	for (uint32_t i = 1; i < _nx; i++)
+	{
+		for (uint32_t j = 1; j < _ny; j++)
+		{
+			GLushort a = (GLushort)((i - 1) + (j - 1)*_nx);
+			GLushort b = (GLushort)(i + (j - 1)*_nx);
+			GLushort c = (GLushort)((i - 1) + j*_nx);
+			GLushort d = (GLushort)(i + j*_nx);
+
+			_compact_indices.push_back(a);
+			_compact_indices.push_back(c);
+			_compact_indices.push_back(b);
+			_compact_indices.push_back(b);
+			_compact_indices.push_back(c);
+			_compact_indices.push_back(d);
+		}
+	}
+}
+
 /**
 * Helper function that calculates the force acting on a particle
 * at a given position
@@ -245,16 +367,15 @@ void ga_cloth_component::update_rk4(struct ga_frame_params* params)
 				p.set_velocity(v1 + (a1 + a2.scale_result(2) + a3.scale_result(2) + a4).scale_result(dt / 6.0f));
 			}
 		}
+
+		apply_lra();
 	}
 }
 
 /**
 * RK4 parallel integration update function. Only updates a given row.
 **/
-void ga_cloth_component::update_rk4_row(struct ga_frame_params* params, uint32_t row) {
-	
-	float dt = std::chrono::duration_cast<std::chrono::duration<float>>(params->_delta_time).count();
-	dt /= _num_iterations;
+void ga_cloth_component::update_rk4_row(float dt, uint32_t row) {
 
 	for (int i = 0; i < _nx; i++)
 	{
@@ -365,6 +486,8 @@ void ga_cloth_component::update_euler(struct ga_frame_params* params)
 
 			}
 		}
+
+		apply_lra();
 	}
 }
 /**
@@ -408,12 +531,133 @@ void ga_cloth_component::update_velocity_verlet(struct ga_frame_params* params)
 				p.set_velocity(v_t_dt);
 			}
 		}
+
+		apply_lra();
 	}
 }
 /**
-* Component update function that is called by sim
+* Precomputes the long range attachments. A multi-source Dijkstra over the
+* structural and shear springs finds, for every particle, the closest fixed
+* particle and the rest length of the shortest path to it through the cloth.
 **/
-void ga_cloth_component::update(struct ga_frame_params* params)
+void ga_cloth_component::compute_lra()
+{
+	const uint32_t k_no_anchor = 0xffffffff;
+	uint32_t count = _nx * _ny;
+
+	_lra_anchor.assign(count, k_no_anchor);
+	_lra_distance.assign(count, FLT_MAX);
+
+	typedef std::pair<float, uint32_t> queue_entry_t;
+	std::priority_queue<queue_entry_t, std::vector<queue_entry_t>, std::greater<queue_entry_t>> open;
+
+	for (uint32_t p = 0; p < count; p++)
+	{
+		if (_particles[p].get_fixed() || _particles[p].get_fixed_to_entity())
+		{
+			_lra_anchor[p] = p;
+			_lra_distance[p] = 0.0f;
+			open.push(queue_entry_t(0.0f, p));
+		}
+	}
+
+	while (!open.empty())
+	{
+		queue_entry_t top = open.top();
+		open.pop();
+
+		uint32_t p = top.second;
+		if (top.first > _lra_distance[p])
+		{
+			continue;
+		}
+
+		int i = p % _nx;
+		int j = p / _nx;
+		for (int dj = -1; dj <= 1; dj++)
+		{
+			for (int di = -1; di <= 1; di++)
+			{
+				int k = i + di;
+				int l = j + dj;
+				if ((di == 0 && dj == 0) || k < 0 || k >= (int)_nx || l < 0 || l >= (int)_ny)
+				{
+					continue;
+				}
+
+				uint32_t q = k + l*_nx;
+				float rest = (_particles[q].get_original_position() - _particles[p].get_original_position()).mag();
+				float distance = top.first + rest;
+				if (distance < _lra_distance[q])
+				{
+					_lra_distance[q] = distance;
+					_lra_anchor[q] = _lra_anchor[p];
+					open.push(queue_entry_t(distance, q));
+				}
+			}
+		}
+	}
+
+	_lra_dirty = false;
+}
+
+/**
+* Projects every particle that has moved out past its attachment distance back
+* onto it, and removes the part of its velocity heading further out
+**/
+void ga_cloth_component::apply_lra()
+{
+	if (!_lra_enabled)
+	{
+		return;
+	}
+
+	if (_lra_dirty)
+	{
+		compute_lra();
+	}
+
+	apply_lra_rows(0, _ny);
+}
+
+/**
+* Applies long range attachments to the particles in [begin_row, end_row).
+* The attachments must already be up to date.
+**/
+void ga_cloth_component::apply_lra_rows(uint32_t begin_row, uint32_t end_row)
+{
+	uint32_t count = _nx * _ny;
+	for (uint32_t p = begin_row * _nx; p < end_row * _nx; p++)
+	{
+		uint32_t anchor = _lra_anchor[p];
+		if (anchor == p || anchor >= count)
+		{
+			continue;
+		}
+
+		ga_cloth_particle& particle = _particles[p];
+		ga_vec3f offset = particle.get_position() - _particles[anchor].get_position();
+		float length = offset.mag();
+		if (length <= _lra_distance[p])
+		{
+			continue;
+		}
+
+		ga_vec3f direction = offset.scale_result(1.0f / length);
+		particle.set_position(_particles[anchor].get_position() + direction.scale_result(_lra_distance[p]));
+
+		float outward = particle.get_velocity().dot(direction);
+		if (outward > 0.0f)
+		{
+			particle.set_velocity(particle.get_velocity() - direction.scale_result(outward));
+		}
+	}
+}
+
+/**
+* Advances the solver by one frame using the selected integration type
+**/
+void ga_cloth_component::simulate(struct ga_frame_params* params)
 {
 	if (_integration_type == Euler)
 	{
@@ -430,41 +674,93 @@ void ga_cloth_component::update(struct ga_frame_params* params)
 	else
 	{
 		// parallel update
-		auto decls = static_cast<ga_job_decl_t*>(alloca(sizeof(ga_job_decl_t) * _ny));
 		float dt = std::chrono::duration_cast<std::chrono::duration<float>>(params->_delta_time).count();
-		struct update_data_t
-		{
-			ga_cloth_component* _cloth;
-			ga_frame_params* _params;
-			uint32_t _row;
-		};
-		auto update_data = static_cast<update_data_t*>(alloca(sizeof(update_data_t) * _ny));
+		dt /= _num_iterations;
 
-		for (int i = 0; i < _ny; ++i)
+		update_rk4_graph(dt);
+	}
+}
+
+/**
+* Parallel RK4 as a job graph. The cloth is cut into blocks of rows with one
+* job per block per iteration. Springs reach at most two rows, so with blocks
+* of at least two rows a block only has to wait for itself and the blocks
+* either side of it to finish the previous iteration. Blocks far apart can
+* run different iterations at once rather than all meeting at a barrier.
+* Row jobs are bulk work and run at low priority, behind entity updates.
+**/
+void ga_cloth_component::update_rk4_graph(float dt)
+{
+	if (_lra_enabled && _lra_dirty)
+	{
+		compute_lra();
+	}
+
+	// a few blocks per worker so stragglers can be balanced
+	uint32_t worker_count = uint32_t(ga_job::get_worker_count());
+	uint32_t block_rows = _ny / (4 * (worker_count > 0 ? worker_count : 1));
+	block_rows = block_rows > 2 ? block_rows : 2;
+	uint32_t block_count = (_ny + block_rows - 1) / block_rows;
+
+	_row_blocks.resize(block_count * _num_iterations);
+	for (int k = 0; k < _num_iterations; k++)
+	{
+		for (uint32_t b = 0; b < block_count; b++)
 		{
-			update_data[i]._cloth = this;
-			update_data[i]._params = params;
-			update_data[i]._row = i;
+			row_block_t& block = _row_blocks[k * block_count + b];
+			block._cloth = this;
+			block._dt = dt;
+			block._begin_row = b * block_rows;
+			block._end_row = block._begin_row + block_rows < _ny ? block._begin_row + block_rows : _ny;
+		}
+	}
 
-			decls[i]._data = update_data + i;
-			decls[i]._entry = [](void* data)
+	_row_graph->clear();
+	for (auto& block : _row_blocks)
+	{
+		_row_graph->add([](void* data)
+		{
+			row_block_t* block = static_cast<row_block_t*>(data);
+			for (uint32_t row = block->_begin_row; row < block->_end_row; row++)
 			{
-				auto update_data = static_cast<update_data_t*>(data);
-				update_data->_cloth->update_rk4_row(update_data->_params, update_data->_row);
-			};
-		}
+				block->_cloth->update_rk4_row(block->_dt, row);
+			}
+			if (block->_cloth->_lra_enabled)
+			{
+				block->_cloth->apply_lra_rows(block->_begin_row, block->_end_row);
+			}
+		}, &block, k_job_priority_low, "cloth rk4 rows");
+	}
 
-		// Dispatch the jobs:
-		int32_t update_counter;
+	for (int k = 1; k < _num_iterations; k++)
+	{
+		for (uint32_t b = 0; b < block_count; b++)
+		{
+			int node = k * block_count + b;
+			int previous = (k - 1) * block_count + b;
 
-		for (int k = 0; k < _num_iterations; k++) {
-			ga_job::run(decls, int(_ny), &update_counter);
-			ga_job::wait(&update_counter);
+			_row_graph->add_dependency(previous, node);
+			if (b > 0) _row_graph->add_dependency(previous - 1, node);
+			if (b + 1 < block_count) _row_graph->add_dependency(previous + 1, node);
 		}
-	}	
-	
-	// draw update
-	update_draw(params);
+	}
+
+	ga_job_counter_t update_counter;
+	_row_graph->run(&update_counter);
+	ga_job::wait(&update_counter);
+}
+
+/**
+* Component update function that is called by sim
+**/
+void ga_cloth_component::update(struct ga_frame_params* params)
+{
+	// playback draws as it decodes, otherwise simulate and then draw
+	if (!_playback_cache || !update_playback(params))
+	{
+		simulate(params);
+		update_draw(params);
+	}
 
 	// Collect user input
 	// structural
@@ -523,9 +819,81 @@ void ga_cloth_component::update(struct ga_frame_params* params)
 		}
 	}
 }
+/**
+* Decodes the next frame of the playback cache straight into a compact
+* drawcall. The cache is already quantised, so the solver, the particles and
+* the normals are all skipped. Returns false if the cache is corrupt, in
+* which case the cloth goes back to simulating.
+**/
+bool ga_cloth_component::update_playback(struct ga_frame_params* params)
+{
+	assert(_playback_cache->get_nx() == _nx && _playback_cache->get_ny() == _ny);
+
+	uint32_t count = _nx * _ny;
+	ga_dynamic_drawcall draw(params->_allocator);
+	draw._packed_positions.resize(count * 3);
+	draw._packed_normals.resize(count * 2);
+	if (!_playback_cache->next_frame(&_playback_cursor, &draw._packed_positions[0], &draw._packed_normals[0]))
+	{
+		std::cerr << "Corrupt cloth cache frame, simulating instead." << std::endl;
+		_playback_cache = nullptr;
+		return false;
+	}
+
+	draw._name = "ga_cloth_dynamic";
+	draw._color = { 0.0f, 0.5f, 1.0f };
+	draw._material = _material;
+	draw._transform = get_entity()->get_transform();
+	draw._draw_mode = GL_TRIANGLES;
+	draw._position_min = _playback_cache->get_position_min();
+	draw._position_extent = _playback_cache->get_position_extent();
+
+	build_compact_indices();
+	draw._indices.assign(_compact_indices.begin(), _compact_indices.end());
+
+	params->_dynamic_drawcall_lock.lock();
+	params->_dynamic_drawcalls.push_back(std::move(draw));
+	params->_dynamic_drawcall_lock.unlock();
+	return true;
+}
+
+/**
+* Offline bake of the cloth animation. Runs the solver with a fixed timestep
+* and records every frame's positions and normals into the cache.
+**/
+void ga_cloth_component::bake(ga_cloth_cache* cache, float frame_dt, uint32_t frame_count, uint32_t blend_frames)
+{
+	ga_frame_params params;
+	params._delta_time = std::chrono::duration_cast<std::chrono::high_resolution_clock::duration>(
+		std::chrono::duration<float>(frame_dt));
+	params._button_mask = 0;
+
+	_draw_positions.resize(_nx * _ny);
+	_draw_normals.resize(_nx * _ny);
+	cache->begin_bake(_nx, _ny);
+
+	for (uint32_t f = 0; f < frame_count; f++)
+	{
+		simulate(&params);
+
+		for (uint32_t j = 0; j < _ny; j++)
+		{
+			for (uint32_t i = 0; i < _nx; i++)
+			{
+				_draw_positions[i + j*_nx] = get_particle(i, j).get_position();
+				_draw_normals[i + j*_nx] = normal_for_point(i, j);
+			}
+		}
+		cache->record_frame(&_draw_positions[0], &_draw_normals[0]);
+	}
+
+	cache->close_loop(blend_frames);
+}
+
 ga_cloth_component::~ga_cloth_component()
 {
 	delete[] _particles;
+	delete _row_graph;
 }
 
 /**
@@ -1,9 +1,11 @@
 #pragma once
 
 #include "entity/ga_component.h"
+#include "ga_cloth_cache.h"
 
 #include <cstdint>
 #include <cassert>
+#include <vector>
 
 class ga_material;
 
@@ -67,6 +69,9 @@ private:
 **/
 class ga_cloth_component : public ga_component
 {
+	// runs row strips of the cloth in separate processes
+	friend class ga_cloth_domain;
+
 public:
 	// Constructor
 	ga_cloth_component(ga_entity* ent, float structural_k, float sheer_k, float bend_k, uint32_t nx, uint32_t ny,
@@ -81,19 +86,29 @@ public:
 	*Public functions to allow cloth particles to be fixed to things
 	**/
 	// Sets cloth particle to be fixed at its current position
-	void set_particle_fixed(int i, int j) { get_particle(i, j).set_fixed(true); }
+	void set_particle_fixed(int i, int j) {
+		get_particle(i, j).set_fixed(true);
+		_lra_dirty = true;
+	}
 	
 	// Sets cloth particle to be fixed at a given position
 	void set_particle_fixed(int i, int j, ga_vec3f fixed_pos) {
 		get_particle(i, j).set_fixed(true);
 		get_particle(i, j).set_position(fixed_pos);
+		_lra_dirty = true;
 	}
 	
 	// Sets a particle to be fixed relative to an entity with an offset
 	void set_particle_fixed_ent(int i, int j, ga_entity* ent, ga_vec3f offset) {
 		get_particle(i, j).set_fixed_to_other_entity(ent, offset);
+		_lra_dirty = true;
 	}
 
+	// Enables long range attachment constraints, which stop each particle from
+	// drifting further from its nearest fixed particle than the rest distance
+	// along the cloth. Lets hanging cloth use far fewer iterations.
+	void set_long_range_attachments(bool enabled) { _lra_enabled = enabled; }
+
 	// Public function to set up material
 	void set_material(class ga_material* material) { _material = material; }
 
@@ -106,17 +121,47 @@ public:
 	void set_num_iterations(int n) { _num_iterations = n; }
 	void set_integration_type(IntegrationType type) { _integration_type = type; }
 
+	/**
+	* Baked animation cache
+	**/
+	// Simulates frame_count frames at a fixed timestep and records them into the cache.
+	// The last blend_frames frames are blended back into the first so the bake loops.
+	void bake(ga_cloth_cache* cache, float frame_dt, uint32_t frame_count, uint32_t blend_frames);
+
+	// Plays back a baked cache every update instead of running the solver.
+	// Frames are decoded straight into compact vertex streams, leaving the
+	// particles where they are. Any number of cloths can share one cache.
+	void set_playback_cache(const ga_cloth_cache* cache)
+	{
+		_playback_cache = cache;
+		_playback_cursor = ga_cloth_cache_cursor_t();
+	}
+
+	// Draws with one shared vertex per particle, 16 bit quantised positions
+	// and octahedral normals instead of full float streams per quad corner
+	void set_compact_vertices(bool compact) { _compact_vertices = compact; }
+
 private:
 
 	// Enum for which type of integration
 	IntegrationType _integration_type;
 	
 	// Various update functions
+	void simulate(struct ga_frame_params* params);
+	bool update_playback(struct ga_frame_params* params);
 	void update_euler(struct ga_frame_params* params);
 	void update_rk4(struct ga_frame_params* params);
-	void update_rk4_row(struct ga_frame_params* params, uint32_t row);
+	void update_rk4_row(float dt, uint32_t row);
+	void update_rk4_graph(float dt);
 	void update_velocity_verlet(struct ga_frame_params* params);
 	void update_draw(struct ga_frame_params* params);
+	void update_draw_compact(struct ga_frame_params* params);
+	void build_compact_indices();
+
+	// Long range attachment helpers
+	void compute_lra();
+	void apply_lra();
+	void apply_lra_rows(uint32_t begin_row, uint32_t end_row);
 
 	// Helper functions to calculate various things in update functions
 	ga_vec3f force_at_pos(int i, int j, ga_vec3f pos);
@@ -151,4 +196,31 @@ private:
 
 	// num iterations for update
 	int _num_iterations;
+
+	// baked cache to play back instead of simulating, if any, and where this cloth is in it
+	const ga_cloth_cache* _playback_cache;
+	ga_cloth_cache_cursor_t _playback_cursor;
+
+	// long range attachments: nearest fixed particle and geodesic rest distance to it
+	bool _lra_enabled;
+	bool _lra_dirty;
+	std::vector<uint32_t> _lra_anchor;
+	std::vector<float> _lra_distance;
+
+	// parallel RK4: one job per block of rows per iteration
+	struct row_block_t
+	{
+		ga_cloth_component* _cloth;
+		float _dt;
+		uint32_t _begin_row;
+		uint32_t _end_row;
+	};
+	class ga_job_graph* _row_graph;
+	std::vector<row_block_t> _row_blocks;
+
+	// compact vertex stream state
+	bool _compact_vertices;
+	std::vector<ga_vec3f> _draw_positions;
+	std::vector<ga_vec3f> _draw_normals;
+	std::vector<uint16_t> _compact_indices;
 };
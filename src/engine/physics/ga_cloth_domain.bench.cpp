@@ -0,0 +1,91 @@
+/**
+* Benchmark for multi-process cloth domains.
+* Simulates an n x n tablecloth split across 1, 2, 4... worker processes and
+* reports time per frame, speedup over a single process, and how far the
+* split result drifts from the single process one.
+*
+* Usage: ga_cloth_domain_bench [n] [frames] [iterations] [max domains]
+**/
+
+#include "ga_cloth_component.h"
+#include "ga_cloth_domain.h"
+
+#include "entity/ga_entity.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+char g_root_path[256];
+
+struct tablecloth_t
+{
+	uint32_t _n;
+	int _iterations;
+};
+
+static ga_cloth_component* create_tablecloth(ga_entity* ent, void* data)
+{
+	tablecloth_t* setup = static_cast<tablecloth_t*>(data);
+	uint32_t n = setup->_n;
+
+	ga_cloth_component* cloth = new ga_cloth_component(ent, 3, 0.5, 0.01, n, n, { -5.0f,0.0f,-5.0f },
+	{ 5.0f,0.0f,-5.0f }, { -5.0f,0.0f,5.0f }, { 5.0f,0.0f,5.0f }, 3.0f);
+
+	uint32_t edge = n / 4;
+	cloth->set_particle_fixed(edge, edge);
+	cloth->set_particle_fixed(edge, n - edge - 1);
+	cloth->set_particle_fixed(n - edge - 1, edge);
+	cloth->set_particle_fixed(n - edge - 1, n - edge - 1);
+
+	cloth->set_num_iterations(setup->_iterations);
+	cloth->set_integration_type(RK4_parallel);
+	return cloth;
+}
+
+int main(int argc, const char** argv)
+{
+	tablecloth_t setup;
+	setup._n = argc > 1 ? atoi(argv[1]) : 161;
+	uint32_t frames = argc > 2 ? atoi(argv[2]) : 60;
+	setup._iterations = argc > 3 ? atoi(argv[3]) : 3;
+	uint32_t max_domains = argc > 4 ? atoi(argv[4]) : 8;
+
+	ga_cloth_domain_config_t config;
+	config._create_cloth = create_tablecloth;
+	config._create_data = &setup;
+	config._frame_count = frames;
+	config._frame_dt = 1.0f / 60.0f;
+
+	printf("cloth %ux%u, %u frames, %d iterations\n", setup._n, setup._n, frames, setup._iterations);
+
+	std::vector<ga_vec3f> reference;
+	double reference_seconds = 0.0;
+	for (uint32_t domains = 1; domains <= max_domains; domains *= 2)
+	{
+		config._domain_count = domains;
+
+		std::vector<ga_vec3f> positions;
+		double seconds;
+		if (!ga_cloth_domain::run(config, positions, &seconds))
+		{
+			return 1;
+		}
+
+		if (domains == 1)
+		{
+			reference = positions;
+			reference_seconds = seconds;
+		}
+
+		float max_error = 0.0f;
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			max_error = ga_max(max_error, (positions[i] - reference[i]).mag());
+		}
+
+		printf("domains %2u: %8.3f ms/frame  speedup %5.2fx  max drift %g\n",
+			domains, seconds * 1000.0 / frames, reference_seconds / seconds, max_error);
+	}
+
+	return 0;
+}
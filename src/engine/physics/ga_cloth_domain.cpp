@@ -0,0 +1,400 @@
+#include "ga_cloth_domain.h"
+#include "ga_cloth_component.h"
+
+#include "entity/ga_entity.h"
+#include "framework/ga_compiler_defines.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#if defined(GA_MSVC) || defined(GA_MINGW)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+static const size_t k_cache_line_size = 64;
+static const uint32_t k_cloth_domain_max = 64;
+
+/**
+* Ring buffer header. Head and tail sit on their own cache lines so the
+* producer and consumer processes don't fight over one line.
+**/
+struct ring_t
+{
+	alignas(64) std::atomic<uint32_t> _head;
+	alignas(64) std::atomic<uint32_t> _tail;
+};
+
+/**
+* State shared by the parent and all worker processes
+**/
+struct ga_cloth_domain_shared_t
+{
+	std::atomic<uint32_t> _ready;
+
+	// Set by the parent when a worker fails, so the rest stop waiting on it
+	std::atomic<uint32_t> _abort;
+
+	double _seconds[k_cloth_domain_max];
+};
+
+static size_t align_up(size_t size, size_t alignment)
+{
+	return (size + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+* Process shared memory. On POSIX an anonymous shared mapping survives fork.
+**/
+static void* map_shared(size_t size)
+{
+#if defined(GA_MSVC) || defined(GA_MINGW)
+	HANDLE map = CreateFileMappingA(INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, 0);
+	if (!map)
+	{
+		return 0;
+	}
+	void* memory = MapViewOfFile(map, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	CloseHandle(map);
+	return memory;
+#else
+	void* memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	return memory == MAP_FAILED ? 0 : memory;
+#endif
+}
+
+static void unmap_shared(void* memory, size_t size)
+{
+#if defined(GA_MSVC) || defined(GA_MINGW)
+	UnmapViewOfFile(memory);
+#else
+	munmap(memory, size);
+#endif
+}
+
+ga_shm_halo_transport::ga_shm_halo_transport(uint32_t domain_count, size_t halo_size, uint32_t slot_count)
+{
+	_domain_count = domain_count;
+	_halo_size = halo_size;
+	_slot_count = slot_count;
+	_abort = 0;
+	_ring_size = align_up(sizeof(ring_t), k_cache_line_size) + slot_count * align_up(halo_size, k_cache_line_size);
+
+	// one ring in each direction between every pair of neighbours
+	uint32_t ring_count = domain_count > 1 ? (domain_count - 1) * 2 : 0;
+	_memory_size = ring_count > 0 ? ring_count * _ring_size : k_cache_line_size;
+	_memory = map_shared(_memory_size);
+
+	for (uint32_t r = 0; _memory && r < ring_count; r++)
+	{
+		ring_t* ring = new ((uint8_t*)_memory + r * _ring_size) ring_t;
+		ring->_head = 0;
+		ring->_tail = 0;
+	}
+}
+
+ga_shm_halo_transport::~ga_shm_halo_transport()
+{
+	if (_memory)
+	{
+		unmap_shared(_memory, _memory_size);
+	}
+}
+
+ring_t* ga_shm_halo_transport::get_ring(uint32_t from, uint32_t to)
+{
+	uint32_t edge = from < to ? from : to;
+	uint32_t direction = from < to ? 0 : 1;
+	return (ring_t*)((uint8_t*)_memory + (edge * 2 + direction) * _ring_size);
+}
+
+bool ga_shm_halo_transport::send(uint32_t from, uint32_t to, const void* data)
+{
+	ring_t* ring = get_ring(from, to);
+	uint8_t* slots = (uint8_t*)ring + align_up(sizeof(ring_t), k_cache_line_size);
+
+	uint32_t tail = ring->_tail.load(std::memory_order_relaxed);
+	while (tail - ring->_head.load(std::memory_order_acquire) >= _slot_count)
+	{
+		if (_abort && _abort->load(std::memory_order_relaxed))
+		{
+			return false;
+		}
+		std::this_thread::yield();
+	}
+
+	memcpy(slots + (tail % _slot_count) * align_up(_halo_size, k_cache_line_size), data, _halo_size);
+	ring->_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool ga_shm_halo_transport::receive(uint32_t from, uint32_t to, void* data)
+{
+	ring_t* ring = get_ring(from, to);
+	uint8_t* slots = (uint8_t*)ring + align_up(sizeof(ring_t), k_cache_line_size);
+
+	uint32_t head = ring->_head.load(std::memory_order_relaxed);
+	while (ring->_tail.load(std::memory_order_acquire) == head)
+	{
+		if (_abort && _abort->load(std::memory_order_relaxed))
+		{
+			return false;
+		}
+		std::this_thread::yield();
+	}
+
+	memcpy(data, slots + (head % _slot_count) * align_up(_halo_size, k_cache_line_size), _halo_size);
+	ring->_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool ga_cloth_domain::run(const ga_cloth_domain_config_t& config, std::vector<ga_vec3f>& positions, double* seconds)
+{
+#if defined(GA_MSVC) || defined(GA_MINGW)
+	std::cerr << "Multi-process cloth domains need fork(), which isn't available on this platform." << std::endl;
+	return false;
+#else
+	// build the cloth once up front just to learn its size
+	uint32_t nx, ny;
+	{
+		ga_entity ent;
+		ga_cloth_component* cloth = config._create_cloth(&ent, config._create_data);
+		nx = cloth->_nx;
+		ny = cloth->_ny;
+		delete cloth;
+	}
+
+	// every strip needs at least two rows to fill its neighbours' halos
+	if (config._domain_count == 0 || config._domain_count > k_cloth_domain_max || ny / config._domain_count < 2)
+	{
+		std::cerr << "Can't split " << ny << " cloth rows into " << config._domain_count << " domains." << std::endl;
+		return false;
+	}
+
+	ga_shm_halo_transport transport(config._domain_count, sizeof(ga_vec3f) * nx * 2, 4);
+
+	size_t shared_size = align_up(sizeof(ga_cloth_domain_shared_t), k_cache_line_size) + sizeof(ga_vec3f) * nx * ny;
+	void* shared_memory = map_shared(shared_size);
+	if (!transport.is_valid() || !shared_memory)
+	{
+		std::cerr << "Failed to map shared memory for cloth domains." << std::endl;
+		if (shared_memory) unmap_shared(shared_memory, shared_size);
+		return false;
+	}
+
+	ga_cloth_domain_shared_t* shared = new (shared_memory) ga_cloth_domain_shared_t;
+	shared->_ready = 0;
+	shared->_abort = 0;
+	transport.set_abort_flag(&shared->_abort);
+	ga_vec3f* shared_positions = (ga_vec3f*)((uint8_t*)shared_memory + align_up(sizeof(ga_cloth_domain_shared_t), k_cache_line_size));
+
+	std::vector<pid_t> workers;
+	for (uint32_t d = 0; d < config._domain_count; d++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+		{
+			_exit(run_worker(config, d, &transport, shared, shared_positions) ? 0 : 1);
+		}
+		else if (pid < 0)
+		{
+			std::cerr << "Failed to start cloth domain worker " << d << "." << std::endl;
+			break;
+		}
+		workers.push_back(pid);
+	}
+
+	// Reap workers as they finish. A missing, crashed or killed worker would
+	// leave its neighbours blocked on its halos, so stop the rest.
+	bool succeeded = workers.size() == config._domain_count;
+	std::vector<pid_t> running = workers;
+	while (!running.empty())
+	{
+		if (!succeeded && !shared->_abort.load())
+		{
+			shared->_abort = 1;
+			for (pid_t pid : running)
+			{
+				kill(pid, SIGKILL);
+			}
+		}
+
+		bool reaped = false;
+		for (size_t w = 0; w < running.size(); w++)
+		{
+			int status;
+			pid_t result = waitpid(running[w], &status, WNOHANG);
+			if (result == 0)
+			{
+				continue;
+			}
+			if (result != running[w] || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			{
+				succeeded = false;
+			}
+			running[w] = running.back();
+			running.pop_back();
+			reaped = true;
+			break;
+		}
+
+		if (!reaped)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	if (!succeeded)
+	{
+		std::cerr << "A cloth domain worker failed, so the run was stopped." << std::endl;
+	}
+	else
+	{
+		positions.assign(shared_positions, shared_positions + nx * ny);
+
+		double slowest = 0.0;
+		for (uint32_t d = 0; d < config._domain_count; d++)
+		{
+			slowest = shared->_seconds[d] > slowest ? shared->_seconds[d] : slowest;
+		}
+		if (seconds)
+		{
+			*seconds = slowest;
+		}
+	}
+
+	unmap_shared(shared_memory, shared_size);
+	return succeeded;
+#endif
+}
+
+/**
+* Body of a worker process. Simulates rows [row_begin, row_end) and keeps the
+* two rows past either end up to date with its neighbours. Returns false if
+* the run was aborted.
+**/
+bool ga_cloth_domain::run_worker(const ga_cloth_domain_config_t& config, uint32_t domain, ga_halo_transport* transport,
+	ga_cloth_domain_shared_t* shared, ga_vec3f* positions)
+{
+	ga_entity ent;
+	ga_cloth_component* cloth = config._create_cloth(&ent, config._create_data);
+
+	uint32_t nx = cloth->_nx;
+	uint32_t ny = cloth->_ny;
+	uint32_t row_begin = ny * domain / config._domain_count;
+	uint32_t row_end = ny * (domain + 1) / config._domain_count;
+	bool has_up = domain > 0;
+	bool has_down = domain + 1 < config._domain_count;
+
+	std::vector<ga_vec3f> halo(nx * 2);
+	auto pack_rows = [&](uint32_t first_row)
+	{
+		for (uint32_t r = 0; r < 2; r++)
+		{
+			for (uint32_t i = 0; i < nx; i++)
+			{
+				halo[i + r*nx] = cloth->get_particle(i, first_row + r).get_position();
+			}
+		}
+	};
+	auto unpack_rows = [&](uint32_t first_row)
+	{
+		for (uint32_t r = 0; r < 2; r++)
+		{
+			for (uint32_t i = 0; i < nx; i++)
+			{
+				cloth->get_particle(i, first_row + r).set_position(halo[i + r*nx]);
+			}
+		}
+	};
+
+	float dt = config._frame_dt / cloth->_num_iterations;
+
+	// attachments are found over the whole cloth, then applied per strip
+	if (cloth->_lra_enabled && cloth->_lra_dirty)
+	{
+		cloth->compute_lra();
+	}
+
+	// start timing once every worker has finished building its cloth
+	shared->_ready++;
+	while (shared->_ready.load() < config._domain_count)
+	{
+		if (shared->_abort.load())
+		{
+			delete cloth;
+			return false;
+		}
+		std::this_thread::yield();
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+
+	for (uint32_t f = 0; f < config._frame_count; f++)
+	{
+		for (int k = 0; k < cloth->_num_iterations; k++)
+		{
+			for (uint32_t row = row_begin; row < row_end; row++)
+			{
+				cloth->update_rk4_row(dt, row);
+			}
+			if (cloth->_lra_enabled)
+			{
+				cloth->apply_lra_rows(row_begin, row_end);
+			}
+
+			// send both edges before receiving so neighbours never wait on each other
+			bool exchanged = true;
+			if (has_up)
+			{
+				pack_rows(row_begin);
+				exchanged = exchanged && transport->send(domain, domain - 1, &halo[0]);
+			}
+			if (has_down)
+			{
+				pack_rows(row_end - 2);
+				exchanged = exchanged && transport->send(domain, domain + 1, &halo[0]);
+			}
+
+			if (has_up && exchanged)
+			{
+				exchanged = transport->receive(domain - 1, domain, &halo[0]);
+				if (exchanged) unpack_rows(row_begin - 2);
+			}
+			if (has_down && exchanged)
+			{
+				exchanged = transport->receive(domain + 1, domain, &halo[0]);
+				if (exchanged) unpack_rows(row_end);
+			}
+
+			if (!exchanged)
+			{
+				delete cloth;
+				return false;
+			}
+		}
+	}
+
+	shared->_seconds[domain] = std::chrono::duration_cast<std::chrono::duration<double>>(
+		std::chrono::high_resolution_clock::now() - start).count();
+
+	for (uint32_t row = row_begin; row < row_end; row++)
+	{
+		for (uint32_t i = 0; i < nx; i++)
+		{
+			positions[i + row*nx] = cloth->get_particle(i, row).get_position();
+		}
+	}
+
+	delete cloth;
+	return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "math/ga_vec3f.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ga_cloth_component;
+class ga_entity;
+
+/**
+* Moves halo rows between neighbouring cloth subdomains.
+* Shared memory is the only transport for now; a socket transport can sit
+* behind the same interface to spread subdomains across machines.
+**/
+class ga_halo_transport
+{
+public:
+	virtual ~ga_halo_transport() {}
+
+	// Sends one halo from domain from to its neighbour to, blocking while the channel is full.
+	// Returns false if the run was aborted while waiting.
+	virtual bool send(uint32_t from, uint32_t to, const void* data) = 0;
+
+	// Receives the next halo sent from domain from to domain to, blocking until it arrives.
+	// Returns false if the run was aborted while waiting.
+	virtual bool receive(uint32_t from, uint32_t to, void* data) = 0;
+};
+
+/**
+* Halo transport over single producer, single consumer ring buffers in a
+* shared memory mapping. The mapping is inherited by forked worker processes.
+**/
+class ga_shm_halo_transport : public ga_halo_transport
+{
+public:
+	ga_shm_halo_transport(uint32_t domain_count, size_t halo_size, uint32_t slot_count);
+	virtual ~ga_shm_halo_transport();
+
+	virtual bool send(uint32_t from, uint32_t to, const void* data) override;
+	virtual bool receive(uint32_t from, uint32_t to, void* data) override;
+
+	bool is_valid() const { return _memory != 0; }
+
+	// Blocked sends and receives give up once the flag is set
+	void set_abort_flag(const std::atomic<uint32_t>* abort) { _abort = abort; }
+
+private:
+	struct ring_t* get_ring(uint32_t from, uint32_t to);
+
+	void* _memory;
+	size_t _memory_size;
+	size_t _ring_size;
+	size_t _halo_size;
+	uint32_t _slot_count;
+	uint32_t _domain_count;
+	const std::atomic<uint32_t>* _abort;
+};
+
+/**
+* Setup for a multi-process cloth run
+**/
+struct ga_cloth_domain_config_t
+{
+	// Builds the cloth in every worker process. Each worker builds the whole
+	// cloth but only simulates its own strip of rows.
+	ga_cloth_component* (*_create_cloth)(ga_entity* ent, void* data);
+	void* _create_data;
+
+	uint32_t _domain_count;
+	uint32_t _frame_count;
+	float _frame_dt;
+};
+
+/**
+* Splits a cloth into horizontal strips, each simulated by its own worker
+* process with RK4. After every iteration neighbouring strips swap the two
+* rows on either side of their shared edge, which is the reach of the bend
+* springs.
+**/
+class ga_cloth_domain
+{
+public:
+	// Runs the simulation and returns the final particle positions along with
+	// the slowest worker's simulation time. Returns false if worker processes
+	// aren't supported on this platform or a worker failed. If one worker
+	// fails, the others are stopped rather than left waiting on its halos.
+	static bool run(const ga_cloth_domain_config_t& config, std::vector<ga_vec3f>& positions, double* seconds);
+
+private:
+	static bool run_worker(const ga_cloth_domain_config_t& config, uint32_t domain, ga_halo_transport* transport,
+		struct ga_cloth_domain_shared_t* shared, ga_vec3f* positions);
+};
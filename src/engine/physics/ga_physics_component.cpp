@@ -31,12 +31,12 @@ void ga_physics_component::update(ga_frame_params* params)
 	_body->_transform = get_entity()->get_transform();
 
 #if GA_PHYSICS_DEBUG_DRAW
-	ga_dynamic_drawcall draw;
+	ga_dynamic_drawcall draw(params->_allocator);
 	_body->get_debug_draw(&draw);
 
-	while (params->_dynamic_drawcall_lock.test_and_set(std::memory_order_acquire)) {}
-	params->_dynamic_drawcalls.push_back(draw);
-	params->_dynamic_drawcall_lock.clear(std::memory_order_release);
+	params->_dynamic_drawcall_lock.lock();
+	params->_dynamic_drawcalls.push_back(std::move(draw));
+	params->_dynamic_drawcall_lock.unlock();
 #endif
 }
 
@@ -49,21 +49,21 @@ ga_physics_world::~ga_physics_world()
 
 void ga_physics_world::add_rigid_body(ga_rigid_body* body)
 {
-	while (_bodies_lock.test_and_set(std::memory_order_acquire)) {}
+	_bodies_lock.lock();
 	_bodies.push_back(body);
-	_bodies_lock.clear(std::memory_order_release);
+	_bodies_lock.unlock();
 }
 
 void ga_physics_world::remove_rigid_body(ga_rigid_body* body)
 {
-	while (_bodies_lock.test_and_set(std::memory_order_acquire)) {}
+	_bodies_lock.lock();
 	_bodies.erase(std::remove(_bodies.begin(), _bodies.end(), body));
-	_bodies_lock.clear(std::memory_order_release);
+	_bodies_lock.unlock();
 }
 
 void ga_physics_world::step(ga_frame_params* params)
 {
-	while (_bodies_lock.test_and_set(std::memory_order_acquire)) {}
+	_bodies_lock.lock();
 
 	// Step the physics sim.
 	for (int i = 0; i < _bodies.size(); ++i)
@@ -83,7 +83,7 @@ void ga_physics_world::step(ga_frame_params* params)
 
 	test_intersections(params);
 
-	_bodies_lock.clear(std::memory_order_release);
+	_bodies_lock.unlock();
 }
 
 void ga_physics_world::test_intersections(ga_frame_params* params)
@@ -105,7 +105,7 @@ void ga_physics_world::test_intersections(ga_frame_params* params)
 					std::chrono::system_clock::now());
 
 #if defined(GA_PHYSICS_DEBUG_DRAW)
-				ga_dynamic_drawcall collision_draw;
+				ga_dynamic_drawcall collision_draw(params->_allocator);
 				collision_draw._positions.push_back(ga_vec3f::zero_vector());
 				collision_draw._positions.push_back(info._normal);
 				collision_draw._indices.push_back(0);
@@ -115,9 +115,9 @@ void ga_physics_world::test_intersections(ga_frame_params* params)
 				collision_draw._material = nullptr;
 				collision_draw._transform.make_translation(info._point);
 
-				while (params->_dynamic_drawcall_lock.test_and_set(std::memory_order_acquire)) {}
-				params->_dynamic_drawcalls.push_back(collision_draw);
-				params->_dynamic_drawcall_lock.clear(std::memory_order_release);
+				params->_dynamic_drawcall_lock.lock();
+				params->_dynamic_drawcalls.push_back(std::move(collision_draw));
+				params->_dynamic_drawcall_lock.unlock();
 #endif
 				// We should not attempt to resolve collisions if we're paused and have not single stepped.
 				bool should_resolve = params->_delta_time > std::chrono::milliseconds(0) || params->_single_step;
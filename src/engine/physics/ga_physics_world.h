@@ -9,9 +9,9 @@
 ** This file is distributed under the MIT License. See LICENSE.txt.
 */
 
+#include "jobs/ga_job_sync.h"
 #include "math/ga_vec3f.h"
 
-#include <atomic>
 #include <vector>
 
 #define GA_PHYSICS_DEBUG_DRAW 1
@@ -37,7 +37,7 @@ public:
 
 private:
 	std::vector<ga_rigid_body*> _bodies;
-	std::atomic_flag _bodies_lock = ATOMIC_FLAG_INIT;
+	ga_job_mutex _bodies_lock;
 
 	ga_vec3f _gravity;
 
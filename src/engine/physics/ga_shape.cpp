@@ -81,7 +81,9 @@ void ga_oobb::get_corners(std::vector<ga_vec3f>& corners) const
 
 void ga_oobb::get_debug_draw(const ga_mat4f& transform, ga_dynamic_drawcall* drawcall)
 {
-	get_corners(drawcall->_positions);
+	std::vector<ga_vec3f> corners;
+	get_corners(corners);
+	drawcall->_positions.assign(corners.begin(), corners.end());
 	drawcall->_positions.push_back(ga_vec3f::zero_vector());
 	drawcall->_positions.push_back(_half_vectors[0]);
 	drawcall->_positions.push_back(_half_vectors[1]);